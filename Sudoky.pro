@@ -11,14 +11,33 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = Sudoky
 TEMPLATE = app
 
+CONFIG += c++14
+
 RC_ICONS = Sudoky_Icon.ico
 
 SOURCES += main.cpp\
         sudoky.cpp \
-    sudoku.cpp
+    sudoku.cpp \
+    serve.cpp \
+    cache.cpp \
+    bulk.cpp \
+    grids.cpp \
+    validate.cpp \
+    latency.cpp \
+    table.cpp \
+    shard.cpp
 
 HEADERS  += \
     sudoky.h \
-    sudoku.h
+    sudoku.h \
+    serve.h \
+    cache.h \
+    bulk.h \
+    queue.h \
+    grids.h \
+    validate.h \
+    latency.h \
+    table.h \
+    shard.h
 
 FORMS    += sudoky.ui
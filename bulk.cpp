@@ -0,0 +1,290 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sudoku.h"
+#include "queue.h"
+#include "grids.h"
+#include "bulk.h"
+
+// see bulk.h for documentation
+
+namespace {
+
+const int QUEUE_SIZE = 64; // items between two stages
+
+// grids transformed from the pool of seeds between two searched grids added to it
+const int SEED_EVERY = 16;
+
+// a puzzle (or full grid) travelling through the pipeline
+struct Item {
+    char cells[81]; // row-major, 0 for blanks
+    signed char diff;
+    signed char blanks; // target number of blanks
+};
+
+// a queue between two stages, with a condition variable for the stages to sleep
+//    on while it is full or empty. Pushes and pops take the lock, so a wake-up
+//    can't be lost between a failed one and the wait; that costs little next
+//    to the solves behind every item.
+struct Link {
+    BoundedQueue<Item> queue;
+    std::mutex lock;
+    std::condition_variable changed; // notified after each push and pop
+
+    Link(): queue(QUEUE_SIZE) {
+    }
+};
+
+// state shared by every stage of one bulk_generate() call
+struct Pipeline {
+    int count;
+    std::vector<int> diffs;
+    std::atomic<int> written[3]; // accepted puzzles per difficulty
+    std::atomic<int> rejected;
+    std::atomic<bool> done;
+
+    Link grids;
+    Link carved;
+    Link verified;
+
+    Pipeline(): rejected(0), done(false) {
+        for (int i = 0; i < 3; ++i) {
+            written[i] = 0;
+        }
+    }
+};
+
+
+// to_cells(sud, cells) copies sud.board into cells
+void to_cells(const Sudoku &sud, char *cells) {
+    for (int i = 0; i < 81; ++i) {
+        cells[i] = sud.board[i / 9][i % 9];
+    }
+}
+
+
+// from_cells(sud, cells) inserts the clues of cells into sud
+// requires: sud->board is empty (0-filled)
+void from_cells(Sudoku *sud, const char *cells) {
+    for (int i = 0; i < 81; ++i) {
+        if (cells[i] != 0) {
+            sud->insert(i / 9, i % 9, cells[i]);
+        }
+    }
+}
+
+
+// send(p, l, item) pushes item to l, sleeping while it is full (backpressure).
+//    Returns false if the pipeline finished while waiting.
+bool send(Pipeline *p, Link *l, const Item &item) {
+    std::unique_lock<std::mutex> guard(l->lock);
+    while (!l->queue.push(item)) {
+        if (p->done) {
+            return false;
+        }
+        l->changed.wait(guard);
+    }
+    l->changed.notify_all();
+    return true;
+}
+
+
+// receive(p, l, item) pops the next item of l, sleeping while it is empty.
+//    Returns false if the pipeline finished while waiting.
+bool receive(Pipeline *p, Link *l, Item *item) {
+    std::unique_lock<std::mutex> guard(l->lock);
+    while (!l->queue.pop(item)) {
+        if (p->done) {
+            return false;
+        }
+        l->changed.wait(guard);
+    }
+    l->changed.notify_all();
+    return true;
+}
+
+
+// finish(p) marks the pipeline done and wakes every stage waiting on a link
+void finish(Pipeline *p) {
+    p->done = true;
+    Link *links[] = {&p->grids, &p->carved, &p->verified};
+    for (int i = 0; i < 3; ++i) {
+        std::lock_guard<std::mutex> guard(links[i]->lock); // not between a check and a wait
+        links[i]->changed.notify_all();
+    }
+}
+
+
+// fill(p) runs the fill stage until the pipeline is done
+void fill(Pipeline *p) {
+    GridSource source(rand());
+    int next = 0; // index in p->diffs of the difficulty of the next grid
+    int drawn = 0;
+
+    while (!p->done) {
+        int d = p->diffs[next];
+        next = (next + 1) % p->diffs.size();
+        if (p->written[d] >= p->count) { // that difficulty is complete
+            std::this_thread::yield();
+            continue;
+        }
+
+        Item item;
+        if (++drawn % SEED_EVERY == 0) { // keep the pool of seeds varied
+            Sudoku fresh;
+            fresh.solve();
+            to_cells(fresh, item.cells);
+            source.add_seed(item.cells);
+        }
+        source.next_grid(item.cells);
+        item.diff = d;
+        item.blanks = blanks_for(d);
+        if (!send(p, &p->grids, item)) {
+            return;
+        }
+    }
+}
+
+
+// carve_stage(p) runs the carve stage until the pipeline is done
+void carve_stage(Pipeline *p) {
+    Item item;
+    while (receive(p, &p->grids, &item)) {
+        Sudoku sud;
+        from_cells(&sud, item.cells);
+
+        if (!carve_exact(&sud, item.blanks)) { // no such puzzle for this grid
+            ++p->rejected;
+            continue;
+        }
+
+        to_cells(sud, item.cells);
+        if (!send(p, &p->carved, item)) {
+            return;
+        }
+    }
+}
+
+
+// verify(p) runs the verify stage until the pipeline is done
+void verify(Pipeline *p) {
+    Item item;
+    while (receive(p, &p->carved, &item)) {
+        Sudoku sud;
+        sud.set_heuristics(FEWEST_PLACES, RANDOM_START);
+        from_cells(&sud, item.cells);
+
+        int blanks = 0;
+        for (int i = 0; i < 81; ++i) {
+            blanks += item.cells[i] == 0;
+        }
+
+        if (blanks != item.blanks || sud.solve() != 1) {
+            ++p->rejected;
+            continue;
+        }
+
+        if (!send(p, &p->verified, item)) {
+            return;
+        }
+    }
+}
+
+} // namespace
+
+
+int bulk_generate(int count, const char *difficulties, FILE *out, int threads) {
+    Pipeline p;
+    p.count = count;
+
+    for (const char *c = difficulties; *c; ++c) {
+        if (*c < '0' || *c > '2') {
+            fprintf(stderr, "generate: difficulties must be made of 0, 1 and 2\n");
+            return 1;
+        }
+        if (std::find(p.diffs.begin(), p.diffs.end(), *c - '0') == p.diffs.end()) {
+            p.diffs.push_back(*c - '0');
+        }
+    }
+    if (p.diffs.empty() || count == 0) {
+        return 0;
+    }
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads < 3) {
+        threads = 3; // one per stage
+    }
+
+    // carving does most of the work (one uniqueness solve per removal attempt),
+    //    filling and verifying take one solve per puzzle
+    int verifiers = threads / 8 > 1 ? threads / 8 : 1;
+    int carvers = threads - verifiers - 1 > 1 ? threads - verifiers - 1 : 1;
+
+    std::vector<std::thread> workers;
+    workers.push_back(std::thread(fill, &p));
+    for (int i = 0; i < carvers; ++i) {
+        workers.push_back(std::thread(carve_stage, &p));
+    }
+    for (int i = 0; i < verifiers; ++i) {
+        workers.push_back(std::thread(verify, &p));
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    Clock::time_point first = start; // first and last puzzle written
+    Clock::time_point last = start;
+
+    int total = count * p.diffs.size();
+    int written = 0;
+    bool ok = true;
+    char board[82];
+    Item item;
+
+    while (written < total && receive(&p, &p.verified, &item)) {
+        if (p.written[item.diff] >= count) { // surplus from the end of the run
+            continue;
+        }
+
+        for (int i = 0; i < 81; ++i) {
+            board[i] = '0' + item.cells[i];
+        }
+        board[81] = '\0';
+        if (fprintf(out, "%d %s\n", item.diff, board) < 0) {
+            ok = false;
+            break;
+        }
+
+        ++p.written[item.diff];
+        last = Clock::now();
+        if (++written == 1) {
+            first = last;
+        }
+    }
+
+    finish(&p);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+    ok = fflush(out) == 0 && ok;
+
+    double elapsed = std::chrono::duration<double>(last - start).count();
+    double steady = std::chrono::duration<double>(last - first).count();
+    fprintf(stderr, "generated %d puzzles in %.2f s: %.1f puzzles/s overall, "
+                    "%.1f puzzles/s steady state, %d rejected\n",
+            written, elapsed, written > 0 ? written / elapsed : 0.0,
+            written > 1 ? (written - 1) / steady : 0.0, (int) p.rejected);
+
+    if (!ok) {
+        perror("generate");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include <cstdio>
+
+// Bulk puzzle generation, run as a pipeline of three parallel stages:
+//    fill   - produces random full grids by transforming a pool of seed grids,
+//             refreshed with searched ones (see grids.h)
+//    carve  - removes clues from each grid (see carve_exact() in sudoku.h)
+//    verify - checks each puzzle has the target number of blanks and exactly
+//             one solution, dropping the ones that don't
+// Stages are joined by bounded lock-free queues (see queue.h). A stage that
+//    finds the next queue full sleeps until it drains, so memory use does not
+//    depend on the number of puzzles requested. Puzzles are written as soon as
+//    they are verified, one per line: "<difficulty> <puzzle>" (81 characters,
+//    '0' for blanks).
+//
+// NOTE: like the rest of the module, the seed for rand() must be set first.
+
+// bulk_generate(count, difficulties, out, threads) writes count puzzles of each
+//    difficulty listed in difficulties ('0' easy, '1' medium, '2' difficult,
+//    e.g. "012") to out, using threads worker threads (0 uses one per core).
+//    Throughput is reported on stderr. Returns a non-zero exit status if
+//    difficulties is invalid or out could not be written.
+// requires: count >= 0
+//           threads >= 0
+int bulk_generate(int count, const char *difficulties, FILE *out, int threads);
+
+#endif // BULK_H
@@ -0,0 +1,198 @@
+#include <cstdio>
+#include <cstring>
+#include "cache.h"
+
+// see cache.h for documentation
+
+namespace {
+
+const char MAGIC[8] = {'S', 'U', 'D', 'O', 'K', 'Y', 'C', '1'}; // start of a saved cache
+
+
+// mix(x) scrambles the bits of x (splitmix64 finalizer)
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+} // namespace
+
+
+SolveCache::SolveCache(size_t entries): sets(1), clock(0) {
+    while (sets * 2 * WAYS <= entries) {
+        sets *= 2;
+    }
+    this->entries = new Entry[sets * WAYS];
+    memset(this->entries, 0, sets * WAYS * sizeof(Entry));
+}
+
+
+SolveCache::~SolveCache() {
+    delete[] entries;
+}
+
+
+void SolveCache::key(const char *cells, uint64_t hash[2]) {
+    // pack the cells 4 bits each into 6 words, then hash them with two
+    //    independent chains to get 128 bits
+    uint64_t words[6] = {0};
+    for (int i = 0; i < 81; ++i) {
+        words[i / 16] |= (uint64_t) cells[i] << (4 * (i % 16));
+    }
+
+    uint64_t h1 = 0x9E3779B97F4A7C15ULL;
+    uint64_t h2 = 0xC2B2AE3D27D4EB4FULL;
+    for (int i = 0; i < 6; ++i) {
+        h1 = mix(h1 ^ words[i]);
+        h2 = mix(h2 + words[i] * 0xFF51AFD7ED558CCDULL);
+    }
+
+    hash[0] = h1;
+    hash[1] = h2;
+}
+
+
+void SolveCache::key(const Sudoku &sud, uint64_t hash[2]) {
+    char cells[81];
+    for (int i = 0; i < 81; ++i) {
+        cells[i] = sud.board[i / 9][i % 9];
+    }
+    key(cells, hash);
+}
+
+
+bool SolveCache::find(const uint64_t hash[2], int *solutions, char *solution) {
+    size_t set = hash[0] & (sets - 1);
+    Entry *e = entries + set * WAYS;
+
+    std::lock_guard<std::mutex> guard(locks[set % LOCKS]);
+    for (int i = 0; i < WAYS; ++i) {
+        if (e[i].stamp != 0 && e[i].hash[0] == hash[0] && e[i].hash[1] == hash[1]) {
+            uint32_t now = ++clock;
+            e[i].stamp = now != 0 ? now : 1;
+
+            *solutions = e[i].solutions;
+            if (e[i].solutions == 1 && solution) {
+                memcpy(solution, e[i].solution, 81);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void SolveCache::store(const uint64_t hash[2], int solutions, const char *solution) {
+    size_t set = hash[0] & (sets - 1);
+    Entry *e = entries + set * WAYS;
+
+    std::lock_guard<std::mutex> guard(locks[set % LOCKS]);
+
+    int victim = 0; // the matching entry, else an empty one, else the least recently used
+    for (int i = 0; i < WAYS; ++i) {
+        if (e[i].stamp != 0 && e[i].hash[0] == hash[0] && e[i].hash[1] == hash[1]) {
+            victim = i;
+            break;
+        }
+        if (e[i].stamp < e[victim].stamp) {
+            victim = i;
+        }
+    }
+
+    uint32_t now = ++clock;
+    e[victim].stamp = now != 0 ? now : 1;
+    e[victim].hash[0] = hash[0];
+    e[victim].hash[1] = hash[1];
+    e[victim].solutions = solutions;
+    if (solutions == 1) {
+        memcpy(e[victim].solution, solution, 81);
+    }
+}
+
+
+int SolveCache::solve(Sudoku *sud) {
+    uint64_t hash[2];
+    char solution[81];
+    int solutions;
+
+    key(*sud, hash);
+
+    if (find(hash, &solutions, solution)) {
+        if (solutions == 1) {
+            for (int i = 0; i < 81; ++i) {
+                if (sud->board[i / 9][i % 9] == 0) {
+                    sud->insert(i / 9, i % 9, solution[i]);
+                }
+            }
+        }
+        return solutions;
+    }
+
+    solutions = sud->solve();
+    if (solutions == 1) {
+        for (int i = 0; i < 81; ++i) {
+            solution[i] = sud->board[i / 9][i % 9];
+        }
+    }
+    store(hash, solutions, solution);
+
+    return solutions;
+}
+
+
+bool SolveCache::save(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = fwrite(MAGIC, sizeof(MAGIC), 1, f) == 1;
+    for (size_t set = 0; set < sets && ok; ++set) {
+        std::lock_guard<std::mutex> guard(locks[set % LOCKS]);
+        for (int i = 0; i < WAYS && ok; ++i) {
+            const Entry &e = entries[set * WAYS + i];
+            if (e.stamp == 0) {
+                continue;
+            }
+            ok = fwrite(e.hash, sizeof(e.hash), 1, f) == 1 &&
+                 fwrite(&e.solutions, 1, 1, f) == 1 &&
+                 fwrite(e.solution, 81, 1, f) == 1;
+        }
+    }
+
+    return fclose(f) == 0 && ok;
+}
+
+
+bool SolveCache::load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    char magic[sizeof(MAGIC)];
+    if (fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        fclose(f);
+        return false;
+    }
+
+    uint64_t hash[2];
+    int8_t solutions;
+    char solution[81];
+    while (fread(hash, sizeof(hash), 1, f) == 1) {
+        if (fread(&solutions, 1, 1, f) != 1 || fread(solution, 81, 1, f) != 1 ||
+                solutions < 0 || solutions > 2) {
+            fclose(f);
+            return false;
+        }
+        store(hash, solutions, solution);
+    }
+
+    fclose(f);
+    return true;
+}
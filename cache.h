@@ -0,0 +1,81 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include "sudoku.h"
+
+// SolveCache remembers the result of Sudoku::solve() (number of solutions and
+//    the solution when it is unique) for previously seen boards, so repeated
+//    puzzles are answered without searching. Boards are keyed by a 128-bit hash
+//    of their 81 cells; a hash collision is treated as impossible. The key does
+//    not include the Variant, so use a separate cache for each variant.
+// The cache has a fixed number of entries (4-way set associative, least recently
+//    used entries are replaced first) and may be shared between threads.
+class SolveCache {
+public:
+    // constructor for SolveCache class - holds at most entries results
+    // requires: entries >= 4
+    explicit SolveCache(size_t entries);
+
+    ~SolveCache();
+
+    // key(cells, hash) stores the 128-bit hash of cells in hash[0], hash[1]
+    // requires: cells has 81 elements from 0 to 9 (0 is a blank), row-major
+    static void key(const char *cells, uint64_t hash[2]);
+
+    // key(sud, hash) stores the 128-bit hash of sud.board in hash[0], hash[1]
+    static void key(const Sudoku &sud, uint64_t hash[2]);
+
+    // find(hash, solutions, solution) returns true if the board with the given hash
+    //    is cached, and stores its number of solutions (0, 1 or 2) in solutions.
+    //    When there is exactly one, its 81 cells (1-9, row-major) are copied into
+    //    solution unless solution is NULL.
+    bool find(const uint64_t hash[2], int *solutions, char *solution);
+
+    // store(hash, solutions, solution) caches the result for the board with the given
+    //    hash, replacing the least recently used entry of its set if it is full
+    // requires: 0 <= solutions <= 2
+    //           solution has 81 elements (1-9) if solutions == 1
+    void store(const uint64_t hash[2], int solutions, const char *solution);
+
+    // solve(sud) behaves like sud->solve(), but checks the cache first and caches
+    //    the result of the search on a miss
+    int solve(Sudoku *sud);
+
+    // save(path) writes every cached result to the file at path.
+    //    Returns false if the file could not be written.
+    bool save(const char *path);
+
+    // load(path) adds the results saved in the file at path to the cache.
+    //    Returns false if the file could not be read or has the wrong format.
+    bool load(const char *path);
+
+private:
+    struct Entry {
+        uint64_t hash[2];
+        uint32_t stamp; // last use, 0 if the entry is empty
+        int8_t solutions;
+        char solution[81];
+    };
+
+    // number of sets (groups of WAYS entries sharing an index), a power of 2
+    size_t sets;
+
+    Entry *entries;
+
+    // entries of set i are guarded by locks[i % LOCKS]
+    static const int WAYS = 4;
+    static const int LOCKS = 256;
+    std::mutex locks[LOCKS];
+
+    // incremented on every access, used to find the least recently used entry
+    std::atomic<uint32_t> clock;
+
+    SolveCache(const SolveCache &);
+    SolveCache &operator=(const SolveCache &);
+};
+
+#endif // CACHE_H
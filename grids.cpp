@@ -0,0 +1,135 @@
+#include "grids.h"
+
+// see grids.h for documentation
+
+namespace {
+
+const int SEEDS = 4;
+
+// full grids found by the solver, in row-major order
+const char *const SEED_GRIDS[SEEDS] = {
+    "914752836532968714876431925357814269421596378689273451265349187748125693193687542",
+    "283951467146237985579846123821379546694528731357614892738465219912783654465192378",
+    "537284691281697435496513287324156978659872143178349562913428756765931824842765319",
+    "318296574594731862267458391426985713135647289879123645952864137783519426641372958",
+};
+
+// SEED_GRIDS as cell values
+struct SeedCells {
+    char cells[SEEDS][81];
+
+    SeedCells() {
+        for (int s = 0; s < SEEDS; ++s) {
+            for (int i = 0; i < 81; ++i) {
+                cells[s][i] = SEED_GRIDS[s][i] - '0';
+            }
+        }
+    }
+};
+
+// seeds() returns the seed grids, converted on first use
+const SeedCells &seeds() {
+    static const SeedCells cells;
+    return cells;
+}
+
+} // namespace
+
+
+void apply_transform(const Transform &t, const char *in, char *out) {
+    for (int r = 0; r < 9; ++r) {
+        for (int c = 0; c < 9; ++c) {
+            int sr = t.rows[r];
+            int sc = t.cols[c];
+            int src = t.transpose ? 9*sc + sr : 9*sr + sc;
+            out[9*r + c] = t.digits[(int) in[src]];
+        }
+    }
+}
+
+
+GridSource::GridSource(uint64_t seed): state(seed * 0x9E3779B97F4A7C15ULL + 1),
+                                       pool_size(0), oldest(0) {
+    if (state == 0) { // xorshift never leaves 0
+        state = 1;
+    }
+    for (int s = 0; s < SEEDS; ++s) {
+        add_seed(seeds().cells[s]);
+    }
+}
+
+
+void GridSource::add_seed(const char *cells) {
+    int s = pool_size;
+    if (pool_size == MAXSEEDS) {
+        s = oldest;
+        oldest = (oldest + 1) % MAXSEEDS;
+    } else {
+        ++pool_size;
+    }
+
+    for (int i = 0; i < 81; ++i) {
+        pool[s][i] = cells[i];
+    }
+}
+
+
+unsigned GridSource::below(unsigned n) {
+    state ^= state >> 12; // xorshift64*
+    state ^= state << 25;
+    state ^= state >> 27;
+    uint32_t x = (state * 0x2545F4914F6CDD1DULL) >> 32;
+    return ((uint64_t) x * n) >> 32;
+}
+
+
+void GridSource::shuffle(char *items, int n) {
+    for (int i = n - 1; i > 0; --i) { // Fisher-Yates
+        int j = below(i + 1);
+        char tmp = items[i];
+        items[i] = items[j];
+        items[j] = tmp;
+    }
+}
+
+
+void GridSource::random_transform(Transform *t) {
+    t->digits[0] = 0;
+    for (int d = 1; d <= 9; ++d) {
+        t->digits[d] = d;
+    }
+    shuffle(t->digits + 1, 9);
+
+    char bands[3] = {0, 1, 2};
+    char stacks[3] = {0, 1, 2};
+    shuffle(bands, 3);
+    shuffle(stacks, 3);
+
+    for (int b = 0; b < 3; ++b) {
+        char rows[3] = {0, 1, 2};
+        char cols[3] = {0, 1, 2};
+        shuffle(rows, 3);
+        shuffle(cols, 3);
+        for (int i = 0; i < 3; ++i) {
+            t->rows[3*b + i] = 3*bands[b] + rows[i];
+            t->cols[3*b + i] = 3*stacks[b] + cols[i];
+        }
+    }
+
+    t->transpose = below(2) == 1;
+}
+
+
+void GridSource::next_grid(char *cells) {
+    Transform t;
+    random_transform(&t);
+    apply_transform(t, pool[below(pool_size)], cells);
+}
+
+
+void GridSource::next_puzzle(const char *puzzle, char *cells) {
+    Transform t;
+    random_transform(&t);
+    apply_transform(t, puzzle, cells);
+}
+
@@ -0,0 +1,73 @@
+#ifndef GRIDS_H
+#define GRIDS_H
+
+#include <cstdint>
+
+// Fast source of random full grids for classic sudoku. Instead of searching, a
+//    seed grid is picked and a random validity-preserving transform is applied:
+//    digit relabeling, row swaps within each band, column swaps within each
+//    stack, band swaps, stack swaps and transposition. Each part of the
+//    transform is drawn uniformly, so every grid equivalent to a seed grid can
+//    come out. The same transforms map a puzzle to an equivalent puzzle with the
+//    same number of solutions, so one verified puzzle yields many more.
+// Grids from one seed are all essentially the same, so a GridSource only has
+//    variety if it is given fresh seeds (see add_seed()): this is meant for bulk
+//    generation, where throughput matters. generate() in sudoku.h searches.
+//
+// Boards are 81 cells in row-major order, 0 for blanks. None of this applies
+//    to variants (see Variant in sudoku.h): their units are not preserved.
+
+struct Transform {
+    char digits[10]; // digit d becomes digits[d], digits[0] is 0
+    char rows[9];    // row r of the result is row rows[r] of the source
+    char cols[9];    // column c of the result is column cols[c] of the source
+    bool transpose;  // the source is transposed first
+};
+
+// apply_transform(t, in, out) stores in out the board in transformed by t
+// requires: in and out have 81 elements and don't overlap
+void apply_transform(const Transform &t, const char *in, char *out);
+
+// GridSource draws random transforms and full grids. Each instance has its own
+//    random number generator and pool of seed grids, so it needs no locking,
+//    but must not be shared between threads.
+class GridSource {
+public:
+    // constructor for GridSource class - seed selects the sequence of grids,
+    //    the pool starts with a few built-in seed grids
+    explicit GridSource(uint64_t seed);
+
+    // add_seed(cells) adds the full grid cells to the pool of seed grids. Once
+    //    the pool holds MAXSEEDS grids, the oldest one is replaced.
+    // requires: cells has 81 elements and is a valid full grid
+    void add_seed(const char *cells);
+
+    // random_transform(t) fills t with a uniformly random transform
+    void random_transform(Transform *t);
+
+    // next_grid(cells) stores a random full grid in cells
+    // requires: cells has 81 elements
+    void next_grid(char *cells);
+
+    // next_puzzle(puzzle, cells) stores in cells a random puzzle equivalent to puzzle
+    // requires: puzzle and cells have 81 elements and don't overlap
+    void next_puzzle(const char *puzzle, char *cells);
+
+    static const int MAXSEEDS = 64;
+
+private:
+    uint64_t state;
+
+    char pool[MAXSEEDS][81];
+    int pool_size;
+    int oldest; // the next grid add_seed() replaces once the pool is full
+
+    // below(n) returns a random integer from 0 to n - 1
+    // requires: n >= 1
+    unsigned below(unsigned n);
+
+    // shuffle(items, n) puts the n items in a uniformly random order
+    void shuffle(char *items, int n);
+};
+
+#endif // GRIDS_H
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <string>
+#include "latency.h"
+
+// see latency.h for documentation
+
+LatencyHistogram::LatencyHistogram(): total(0), longest(0) {
+    for (int i = 0; i < BUCKETS; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+int LatencyHistogram::bucket(uint64_t ns) {
+    if (ns < (2u << SUB_BITS)) { // exact
+        return ns;
+    }
+
+    int exp = 63 - __builtin_clzll(ns);
+    if (exp > MAX_EXP) {
+        return BUCKETS - 1;
+    }
+    int shift = exp - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) + ((ns >> shift) & ((1 << SUB_BITS) - 1));
+}
+
+
+uint64_t LatencyHistogram::lowest(int idx) {
+    if (idx < (2 << SUB_BITS)) {
+        return idx;
+    }
+
+    int shift = (idx >> SUB_BITS) - 1;
+    uint64_t sub = idx & ((1 << SUB_BITS) - 1);
+    return ((1ULL << SUB_BITS) + sub) << shift;
+}
+
+
+void LatencyHistogram::record(uint64_t ns) {
+    buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t old = longest.load(std::memory_order_relaxed);
+    while (ns > old && !longest.compare_exchange_weak(old, ns, std::memory_order_relaxed)) {
+    }
+}
+
+
+uint64_t LatencyHistogram::count() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+
+uint64_t LatencyHistogram::max() const {
+    return longest.load(std::memory_order_relaxed);
+}
+
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+
+    // rank of the duration we want, from 1 to n
+    uint64_t rank = (uint64_t) (p / 100 * n + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, n));
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t high = i + 1 < BUCKETS ? lowest(i + 1) - 1 : max();
+            return std::min(high, max());
+        }
+    }
+
+    return max();
+}
+
+
+void LatencyHistogram::write_json(FILE *out) const {
+    fprintf(out, "{\"count\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+                 "\"p99.9_ns\": %llu, \"max_ns\": %llu, \"buckets\": [",
+            (unsigned long long) count(), (unsigned long long) percentile(50),
+            (unsigned long long) percentile(99), (unsigned long long) percentile(99.9),
+            (unsigned long long) max());
+
+    bool first = true;
+    for (int i = 0; i < BUCKETS; ++i) {
+        uint64_t n = buckets[i].load(std::memory_order_relaxed);
+        if (n != 0) {
+            fprintf(out, "%s[%llu, %llu]", first ? "" : ", ",
+                    (unsigned long long) lowest(i), (unsigned long long) n);
+            first = false;
+        }
+    }
+
+    fprintf(out, "]}");
+}
+
+
+SlowBoards::SlowBoards(int k): k(k), size(0), slow(new Slow[k > 0 ? k : 1]), threshold(0) {
+}
+
+
+SlowBoards::~SlowBoards() {
+    delete[] slow;
+}
+
+
+void SlowBoards::offer(uint64_t ns, const char *board) {
+    if (k == 0 || ns <= threshold.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    int fastest = 0; // the place to overwrite
+    if (size < k) {
+        fastest = size++;
+    } else {
+        for (int i = 1; i < k; ++i) {
+            if (slow[i].ns < slow[fastest].ns) {
+                fastest = i;
+            }
+        }
+        if (ns <= slow[fastest].ns) { // another thread got in first
+            return;
+        }
+    }
+
+    slow[fastest].ns = ns;
+    std::copy(board, board + 81, slow[fastest].board);
+
+    if (size == k) {
+        uint64_t low = slow[0].ns;
+        for (int i = 1; i < k; ++i) {
+            low = std::min(low, slow[i].ns);
+        }
+        threshold.store(low, std::memory_order_relaxed);
+    }
+}
+
+
+bool SlowBoards::save(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::sort(slow, slow + size, [](const Slow &a, const Slow &b) { return a.ns > b.ns; });
+
+    bool ok = true;
+    for (int i = 0; i < size && ok; ++i) {
+        char line[82];
+        for (int j = 0; j < 81; ++j) {
+            line[j] = '0' + slow[i].board[j];
+        }
+        line[81] = '\0';
+        ok = fprintf(f, "%llu %s\n", (unsigned long long) slow[i].ns, line) > 0;
+    }
+
+    return fclose(f) == 0 && ok;
+}
+
+
+LatencyRecorder::LatencyRecorder(int k): slow_solves(k), slow_generates(k) {
+}
+
+
+bool LatencyRecorder::report(const char *prefix) {
+    std::string base(prefix);
+
+    FILE *f = fopen((base + ".json").c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "{\"solve\": ");
+    solve_times.write_json(f);
+    fprintf(f, ",\n \"generate\": ");
+    generate_times.write_json(f);
+    fprintf(f, "}\n");
+    bool ok = fclose(f) == 0;
+
+    ok = slow_solves.save((base + ".solve.slow").c_str()) && ok;
+    ok = slow_generates.save((base + ".generate.slow").c_str()) && ok;
+    return ok;
+}
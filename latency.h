@@ -0,0 +1,112 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+// LatencyHistogram counts durations (in nanoseconds) in HDR-style buckets:
+//    exact below 128 ns, then 64 buckets per power of 2, so any reported value
+//    is within 1.6% of the real one. record() is lock-free and may be called
+//    from any number of threads at once.
+class LatencyHistogram {
+public:
+    // constructor for LatencyHistogram class - no input required, empty
+    LatencyHistogram();
+
+    // record(ns) adds one duration of ns nanoseconds
+    void record(uint64_t ns);
+
+    // count() returns the number of recorded durations
+    uint64_t count() const;
+
+    // max() returns the longest recorded duration (exact), 0 if there are none
+    uint64_t max() const;
+
+    // percentile(p) returns the duration below which p percent of the recorded
+    //    ones fall (the upper end of its bucket), 0 if there are none
+    // requires: 0 <= p <= 100
+    uint64_t percentile(double p) const;
+
+    // write_json(out) writes the count, p50/p99/p99.9/max and the non-empty
+    //    buckets ([lowest ns, count] pairs) to out as a JSON object
+    void write_json(FILE *out) const;
+
+private:
+    static const int SUB_BITS = 6;
+    static const int MAX_EXP = 44; // durations of 2^45 ns (about 10 hours) or more share the last bucket
+    static const int BUCKETS = (MAX_EXP - SUB_BITS + 2) << SUB_BITS;
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> longest;
+
+    // bucket(ns) returns the index of the bucket of ns
+    static int bucket(uint64_t ns);
+
+    // lowest(idx) returns the shortest duration counted in bucket idx
+    static uint64_t lowest(int idx);
+};
+
+
+// SlowBoards keeps the boards of the K slowest calls seen, for later replay.
+//    Calls faster than the K-th slowest kept so far are rejected without locking.
+class SlowBoards {
+public:
+    // constructor for SlowBoards class - keeps at most k boards
+    // requires: k >= 0
+    explicit SlowBoards(int k);
+
+    ~SlowBoards();
+
+    // offer(ns, board) keeps board (81 digits, 0 for blanks) if a call of ns
+    //    nanoseconds is one of the K slowest so far
+    void offer(uint64_t ns, const char *board);
+
+    // save(path) writes the kept boards to the file at path, slowest first, one
+    //    per line: "<ns> <board>" (see read_board() in sudoku.h). Returns false
+    //    if the file could not be written.
+    bool save(const char *path);
+
+private:
+    struct Slow {
+        uint64_t ns;
+        char board[81];
+    };
+
+    int k;
+    int size;
+    Slow *slow;
+    std::mutex lock;
+
+    // while all K places are taken, the duration of the fastest kept call
+    std::atomic<uint64_t> threshold;
+
+    SlowBoards(const SlowBoards &);
+    SlowBoards &operator=(const SlowBoards &);
+};
+
+
+// LatencyRecorder gathers the latencies of the solve() and generate() (or carve())
+//    entry points of the sudoku module (see set_recorder() in sudoku.h).
+class LatencyRecorder {
+public:
+    // constructor for LatencyRecorder class - keeps the k slowest boards of each kind
+    // requires: k >= 0
+    explicit LatencyRecorder(int k);
+
+    LatencyHistogram solve_times;
+    LatencyHistogram generate_times;
+
+    // inputs of the slowest solve() calls, and outputs of the slowest generate() calls
+    SlowBoards slow_solves;
+    SlowBoards slow_generates;
+
+    // report(prefix) writes both histograms to <prefix>.json and the slowest
+    //    boards to <prefix>.solve.slow and <prefix>.generate.slow. Returns false
+    //    if a file could not be written.
+    bool report(const char *prefix);
+};
+
+#endif // LATENCY_H
@@ -1,11 +1,109 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cstdio>
 #include <QApplication>
 #include "sudoky.h"
+#include "serve.h"
+#include "bulk.h"
+#include "validate.h"
+#include "shard.h"
+#include "latency.h"
 
-int main(int argc, char *argv[])
+// Usage:
+//    Sudoky                              starts the game
+//    Sudoky --serve <address> [threads] [cache file]
+//                                        runs the solve/generate daemon (see serve.h)
+//    Sudoky --generate <count> <difficulties> [output file] [threads]
+//                                        writes count puzzles of each difficulty (see bulk.h)
+//    Sudoky --validate <file>            checks a file of solved grids (see validate.h)
+//    Sudoky --shard <task> <input file> <work dir> <shards> [processes] [part/parts]
+//                                        solves, rates or generates from a large file
+//                                        in resumable shards (see shard.h)
+//
+// If the SUDOKY_LATENCY environment variable is set, the latency of every solve
+//    and generate call is recorded, and reported to files starting with its value
+//    when the program ends (see LatencyRecorder in latency.h).
+
+const int SLOWEST = 100; // boards kept of the slowest calls
+
+
+// run(argc, argv) runs the mode selected by the command line, and returns its exit status
+int run(int argc, char *argv[])
 {
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0) { // no Qt needed
+        if (argc < 3) {
+            fprintf(stderr, "usage: %s --serve <socket path | port> [threads] [cache file]\n", argv[0]);
+            return 1;
+        }
+        srand(time(NULL));
+        return serve(argv[2], argc >= 4 ? atoi(argv[3]) : 0, argc >= 5 ? argv[4] : NULL);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--generate") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "usage: %s --generate <count> <difficulties, e.g. 012> [output file] [threads]\n", argv[0]);
+            return 1;
+        }
+        FILE *out = stdout;
+        if (argc >= 5 && strcmp(argv[4], "-") != 0) {
+            out = fopen(argv[4], "w");
+            if (!out) {
+                perror(argv[4]);
+                return 1;
+            }
+        }
+        srand(time(NULL));
+        int status = bulk_generate(atoi(argv[2]), argv[3], out, argc >= 6 ? atoi(argv[5]) : 0);
+        if (out != stdout) {
+            fclose(out);
+        }
+        return status;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--validate") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "usage: %s --validate <file>\n", argv[0]);
+            return 2;
+        }
+        return validate_file(argv[2], stdout);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--shard") == 0) {
+        int part = 0;
+        int parts = 1;
+        if (argc < 6 || atoi(argv[5]) < 1 || (argc >= 8 &&
+                (sscanf(argv[7], "%d/%d", &part, &parts) != 2 || part < 0 || part >= parts))) {
+            fprintf(stderr, "usage: %s --shard <solve | rate | generate> <input file> <work dir> "
+                            "<shards> [processes] [part/parts, e.g. 0/2]\n", argv[0]);
+            return 1;
+        }
+        srand(time(NULL));
+        return shard_run(argv[2], argv[3], argv[4], atoi(argv[5]),
+                         argc >= 7 ? atoi(argv[6]) : 0, part, parts);
+    }
+
     QApplication a(argc, argv);
     Sudoky w;
     w.show();
 
     return a.exec();
 }
+
+
+int main(int argc, char *argv[])
+{
+    const char *report = getenv("SUDOKY_LATENCY");
+    LatencyRecorder *recorder = NULL;
+    if (report) {
+        recorder = new LatencyRecorder(SLOWEST);
+        set_recorder(recorder);
+    }
+
+    int status = run(argc, argv);
+
+    if (recorder && !recorder->report(report)) {
+        perror(report);
+    }
+    return status;
+}
@@ -0,0 +1,97 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// BoundedQueue<T> is a fixed-capacity, lock-free queue that any number of
+//    threads may push to and pop from at the same time (Vyukov's bounded MPMC
+//    ring). Each slot carries a sequence number telling producers and consumers
+//    whose turn it is, so no operation ever waits for a lock.
+// push() and pop() never block: a full (or empty) queue makes them return false,
+//    and the caller decides how to wait. This is what gives backpressure.
+template <typename T>
+class BoundedQueue {
+public:
+    // constructor for BoundedQueue class - holds at most capacity items
+    //    (rounded up to a power of 2)
+    // requires: capacity >= 1
+    explicit BoundedQueue(size_t capacity): mask(0), head(0), tail(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        mask = size - 1;
+
+        slots = new Slot[size];
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~BoundedQueue() {
+        delete[] slots;
+    }
+
+    // push(item) adds a copy of item at the back of the queue. Returns false
+    //    (and does nothing) if the queue is full.
+    bool push(const T &item) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &s = slots[pos & mask];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            long diff = (long) seq - (long) pos;
+            if (diff == 0) { // slot is free, try to claim it
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.item = item;
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) { // slot still holds an item from the last lap
+                return false;
+            } else { // another producer claimed pos, reload
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // pop(item) removes the item at the front of the queue and stores it in item.
+    //    Returns false (and does nothing) if the queue is empty.
+    bool pop(T *item) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &s = slots[pos & mask];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            long diff = (long) seq - (long) (pos + 1);
+            if (diff == 0) { // slot is full, try to claim it
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    *item = s.item;
+                    s.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) { // slot not written yet
+                return false;
+            } else { // another consumer claimed pos, reload
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    Slot *slots;
+    size_t mask;
+
+    // producers and consumers are kept on separate cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+    BoundedQueue(const BoundedQueue &);
+    BoundedQueue &operator=(const BoundedQueue &);
+};
+
+#endif // QUEUE_H
@@ -0,0 +1,389 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include "sudoku.h"
+#include "cache.h"
+#include "serve.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+// see serve.h for documentation
+
+namespace {
+
+// requests received together on one connection, answered by the worker pool
+struct Batch {
+    std::vector<std::string> requests;
+    std::vector<std::string> responses;
+    std::vector<bool> done;
+    std::mutex lock;
+    std::condition_variable answered;
+};
+
+// one request of a batch waiting for a worker
+struct Task {
+    Batch *batch;
+    int index;
+};
+
+const size_t CACHE_ENTRIES = 1 << 18; // about 26 MB
+
+// longest request line accepted: requests are under 100 characters, and a client
+//    sending more without a newline would otherwise grow its buffer without limit
+const size_t MAX_LINE = 256;
+
+// results of previous solve requests, NULL if caching is disabled
+SolveCache *cache = NULL;
+
+// set by a SIGINT or SIGTERM to stop accepting connections
+volatile sig_atomic_t stopping = 0;
+
+std::deque<Task> tasks;
+std::mutex tasks_lock;
+std::condition_variable tasks_ready;
+bool finishing = false; // set once no more tasks will be queued, ends the workers
+
+// open connections, shut down when the daemon stops so their handlers return
+std::set<int> clients;
+std::mutex clients_lock;
+std::condition_variable clients_closed;
+
+
+// answer(req) computes the response line (without newline) for the request line req
+std::string answer(const std::string &req) {
+    char board[82];
+
+    if (req.compare(0, 6, "solve ") == 0) {
+        // the cache is probed with the hash of the text, so a hit builds no Sudoku
+        char cells[81];
+        bool ok = req.size() == 6 + 81;
+        for (int i = 0; ok && i < 81; ++i) {
+            char ch = req[6 + i];
+            ok = ch == '.' || ('0' <= ch && ch <= '9');
+            cells[i] = ch == '.' ? 0 : ch - '0';
+        }
+        if (!ok) {
+            return "error board must have 81 characters from 0-9 or .";
+        }
+
+        uint64_t hash[2];
+        int solutions;
+        if (cache) {
+            SolveCache::key(cells, hash);
+            if (cache->find(hash, &solutions, cells)) {
+                if (solutions != 1) {
+                    return std::to_string(solutions);
+                }
+                for (int i = 0; i < 81; ++i) {
+                    board[i] = '0' + cells[i];
+                }
+                board[81] = '\0';
+                return "1 " + std::string(board);
+            }
+        }
+
+        Sudoku sud;
+        sud.set_heuristics(FEWEST_PLACES, RANDOM_START); // the solution shown is unique
+        read_board(&sud, req.c_str() + 6);
+        solutions = sud.solve();
+        write_board(sud, board);
+        if (cache) { // the miss above already has the hash
+            for (int i = 0; i < 81; ++i) {
+                cells[i] = board[i] - '0';
+            }
+            cache->store(hash, solutions, cells);
+        }
+        if (solutions != 1) {
+            return std::to_string(solutions);
+        }
+        return "1 " + std::string(board);
+
+    } else if (req.compare(0, 9, "generate ") == 0) {
+        const char *text = req.c_str() + 9;
+        char *end;
+        long blanks = strtol(text, &end, 10);
+        if (end == text || *end != '\0' || blanks < 0 || blanks > 81) {
+            return "error blanks must be between 0 and 81";
+        }
+
+        Sudoku sud;
+        int result = generate(&sud, blanks);
+        write_board(sud, board);
+        return std::to_string(result) + " " + std::string(board);
+    }
+
+    return "error unknown request";
+}
+
+
+// work() runs on each worker thread, answering queued tasks until finishing is
+//    set and none are left
+void work() {
+    for (;;) {
+        Task t;
+        {
+            std::unique_lock<std::mutex> guard(tasks_lock);
+            tasks_ready.wait(guard, [] { return !tasks.empty() || finishing; });
+            if (tasks.empty()) {
+                return;
+            }
+            t = tasks.front();
+            tasks.pop_front();
+        }
+
+        std::string res = answer(t.batch->requests[t.index]);
+
+        std::lock_guard<std::mutex> guard(t.batch->lock);
+        t.batch->responses[t.index] = res;
+        t.batch->done[t.index] = true;
+        t.batch->answered.notify_one();
+    }
+}
+
+#ifndef _WIN32
+
+// stop(sig) handles SIGINT and SIGTERM by interrupting the accept loop
+void stop(int) {
+    stopping = 1;
+}
+
+
+// start(f, args) starts a thread running f(args) with SIGINT and SIGTERM
+//    blocked, so that they are delivered to the main thread, interrupting accept()
+template <typename F, typename... Args>
+std::thread start(F f, Args... args) {
+    sigset_t block;
+    sigset_t old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old); // inherited by the new thread
+
+    std::thread t(f, args...);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return t;
+}
+
+
+// write_all(fd, data, len) writes all of data to fd, returns false on error
+bool write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+// handle(fd) reads pipelined requests from the connection fd in batches and
+//    writes the responses back in order, until the client disconnects or the
+//    connection is shut down. Then fd is taken out of clients and closed.
+void handle(int fd) {
+    std::string pending; // received bytes not yet forming a full line
+    char buf[65536];
+    bool open = true;
+
+    while (open) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        pending.append(buf, n);
+
+        Batch batch;
+        size_t start = 0;
+        size_t end;
+        bool too_long = false;
+        while ((end = pending.find('\n', start)) != std::string::npos) {
+            size_t len = end - start;
+            if (len > MAX_LINE + 1) { // room for a '\r'
+                too_long = true;
+                break;
+            }
+            if (len > 0 && pending[end - 1] == '\r') {
+                --len;
+            }
+            batch.requests.push_back(pending.substr(start, len));
+            start = end + 1;
+        }
+        pending.erase(0, start);
+        too_long = too_long || pending.size() > MAX_LINE + 1;
+
+        // the lines before a line that is too long are still answered
+        int count = batch.requests.size();
+        if (count == 0 && !too_long) {
+            continue;
+        }
+        batch.responses.resize(count);
+        batch.done.resize(count, false);
+
+        { // the whole batch is queued under a single lock acquisition
+            std::lock_guard<std::mutex> guard(tasks_lock);
+            for (int i = 0; i < count; ++i) {
+                Task t = {&batch, i};
+                tasks.push_back(t);
+            }
+        }
+        tasks_ready.notify_all();
+
+        // stream responses back in request order. All of them are waited for
+        //    even after a write error, since the workers still reference batch
+        for (int i = 0; i < count; ++i) {
+            std::string res;
+            {
+                std::unique_lock<std::mutex> guard(batch.lock);
+                batch.answered.wait(guard, [&] { return batch.done[i]; });
+                res.swap(batch.responses[i]);
+            }
+            res += '\n';
+            if (open && !write_all(fd, res.data(), res.size())) {
+                open = false;
+            }
+        }
+
+        if (too_long) {
+            const char *err = "error line too long\n";
+            write_all(fd, err, strlen(err));
+            open = false;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(clients_lock);
+    clients.erase(fd); // before closing, so the number is not shut down once reused
+    close(fd);
+    clients_closed.notify_all();
+}
+
+#endif
+
+} // namespace
+
+
+int serve(const char *address, int threads, const char *cache_path) {
+#ifdef _WIN32
+    (void) address;
+    (void) threads;
+    (void) cache_path;
+    fprintf(stderr, "serve: not supported on this platform\n");
+    return 1;
+#else
+    signal(SIGPIPE, SIG_IGN); // a client hanging up must not kill the daemon
+
+    struct sigaction act; // no SA_RESTART, so accept() returns on a signal
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = stop;
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    if (cache_path) {
+        cache = new SolveCache(CACHE_ENTRIES);
+        if (!cache->load(cache_path)) {
+            fprintf(stderr, "serve: starting with an empty cache\n");
+        }
+    }
+
+    bool tcp = address[0] != '\0' && strspn(address, "0123456789") == strlen(address);
+    int fd;
+
+    if (tcp) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || bind(fd, (sockaddr *) &addr, sizeof(addr)) != 0) {
+            perror("serve");
+            return 1;
+        }
+    } else {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "serve: socket path too long\n");
+            return 1;
+        }
+        strcpy(addr.sun_path, address);
+        unlink(address);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (sockaddr *) &addr, sizeof(addr)) != 0) {
+            perror("serve");
+            return 1;
+        }
+    }
+
+    if (listen(fd, 64) != 0) {
+        perror("serve");
+        return 1;
+    }
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 1;
+        }
+    }
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(start(work));
+    }
+
+    while (!stopping) {
+        int client = accept(fd, NULL, NULL);
+        if (client >= 0) {
+            std::lock_guard<std::mutex> guard(clients_lock);
+            clients.insert(client);
+            start(handle, client).detach();
+        }
+    }
+    close(fd);
+
+    // the handlers return once their connection is shut down (after the
+    //    workers answer the batch they are waiting for). Then no tasks are left
+    {
+        std::unique_lock<std::mutex> guard(clients_lock);
+        for (std::set<int>::iterator it = clients.begin(); it != clients.end(); ++it) {
+            shutdown(*it, SHUT_RDWR);
+        }
+        clients_closed.wait(guard, [] { return clients.empty(); });
+    }
+    {
+        std::lock_guard<std::mutex> guard(tasks_lock);
+        finishing = true;
+    }
+    tasks_ready.notify_all();
+    for (int i = 0; i < threads; ++i) {
+        workers[i].join();
+    }
+
+    if (cache && !cache->save(cache_path)) {
+        perror("serve");
+        return 1;
+    }
+    return 0;
+#endif
+}
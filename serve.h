@@ -0,0 +1,37 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+// Daemon mode for the sudoku module: a long-running process that answers
+//    solve and generate requests over a Unix domain socket or a localhost TCP
+//    port, so clients don't pay for process startup on every puzzle.
+//
+// Protocol (one request per line, any number of requests may be pipelined):
+//    solve <board>       ->  <solutions> [<solution>]
+//    generate <blanks>   ->  <blanks> <puzzle>
+//    anything else       ->  error <message>
+// where boards are 81 characters in row-major order ('0' or '.' for blanks, see
+//    read_board() in sudoku.h). The solution is only sent when it is unique.
+//    Responses are written in the same order as the requests on each connection.
+//    A line longer than 256 characters gets "error line too long", after which
+//    the connection is closed.
+//
+// Every line already received on a connection is coalesced into one batch,
+//    queued at once on a shared pool of worker threads, and the responses are
+//    streamed back as soon as all earlier requests of the batch are answered.
+//
+// NOTE: like the rest of the module, the seed for rand() must be set first.
+
+// serve(address, threads, cache_path) listens on address and answers requests
+//    until the process receives SIGINT or SIGTERM. If address only contains digits, it is a TCP port on
+//    127.0.0.1, otherwise it is the path of a Unix domain socket (replaced if it
+//    exists). threads is the size of the worker pool (0 uses one per core).
+//    If cache_path is not NULL, solve results are cached (see cache.h), the
+//    cache is loaded from cache_path if it exists, and it is saved back to
+//    cache_path before returning. Before that, open connections are shut down
+//    and every thread started is finished, so the process can exit.
+//    Returns a non-zero exit status if the socket could not be set up or the
+//    cache could not be saved.
+// requires: threads >= 0
+int serve(const char *address, int threads, const char *cache_path);
+
+#endif // SERVE_H
@@ -0,0 +1,418 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "shard.h"
+#include "sudoku.h"
+
+// see shard.h for documentation
+
+namespace {
+
+#ifndef _WIN32
+
+enum Task {SOLVE, RATE, GENERATE};
+
+const char *const TASKS[] = {"solve", "rate", "generate"};
+
+const int CHECKPOINT_LINES = 1000; // lines processed between checkpoints
+
+struct Job {
+    Task task;
+    std::string input;
+    std::string dir;
+    int shards;
+    std::vector<long> bounds; // shard n covers the input from bounds[n] to bounds[n + 1]
+};
+
+
+// path(job, name) returns the path of the file called name in the directory of job
+std::string path(const Job &job, const std::string &name) {
+    return job.dir + "/" + name;
+}
+
+
+// shard_path(job, n, ext) returns the path of the file of shard n with extension ext
+std::string shard_path(const Job &job, int n, const char *ext) {
+    return path(job, "shard-" + std::to_string(n) + ext);
+}
+
+
+// line_start(in, pos, size) returns the offset of the first line of in (of size
+//    bytes) starting at or after pos, -1 if in could not be read
+long line_start(FILE *in, long pos, long size) {
+    if (pos <= 0) {
+        return 0;
+    }
+    if (pos >= size) {
+        return size;
+    }
+    if (fseek(in, pos - 1, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    int ch;
+    while ((ch = getc(in)) != EOF && ch != '\n') {
+    }
+    return ch == EOF ? size : ftell(in);
+}
+
+
+// open_job(job, size) checks that the directory of job holds no other job (one
+//    with another task, input size or shard count), claiming it for job if it is
+//    new. Returns false, after reporting why, otherwise.
+bool open_job(const Job &job, long size) {
+    if (mkdir(job.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        perror(job.dir.c_str());
+        return false;
+    }
+
+    char desc[64];
+    snprintf(desc, sizeof desc, "%s %ld %d\n", TASKS[job.task], size, job.shards);
+
+    std::string job_path = path(job, "job");
+    FILE *f = fopen(job_path.c_str(), "r");
+    if (f) {
+        char found[64] = "";
+        bool read = fgets(found, sizeof found, f) != NULL;
+        fclose(f);
+        if (!read || strcmp(found, desc) != 0) {
+            fprintf(stderr, "shard: %s holds another job (%s is: task, input size, shards)\n",
+                    job.dir.c_str(), job_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    f = fopen(job_path.c_str(), "w");
+    if (!f || fputs(desc, f) < 0 || fclose(f) != 0) {
+        perror(job_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// load_checkpoint(job, n, offset, written) reads the checkpoint of shard n: the
+//    input up to offset has its results in the first written bytes of the output.
+//    Returns false if there is none.
+bool load_checkpoint(const Job &job, int n, long *offset, long *written) {
+    FILE *f = fopen(shard_path(job, n, ".ckpt").c_str(), "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = fscanf(f, "%ld %ld", offset, written) == 2;
+    fclose(f);
+    return ok;
+}
+
+
+// save_checkpoint(job, n, offset, written) replaces the checkpoint of shard n
+//    (see load_checkpoint()) at once, so that a crash leaves the old or the new one.
+//    Returns false if it could not be written.
+bool save_checkpoint(const Job &job, int n, long offset, long written) {
+    std::string ckpt = shard_path(job, n, ".ckpt");
+    std::string tmp = ckpt + ".tmp";
+
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    bool ok = fprintf(f, "%ld %ld\n", offset, written) > 0;
+    ok = fflush(f) == 0 && ok;
+    ok = fsync(fileno(f)) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+    return ok && rename(tmp.c_str(), ckpt.c_str()) == 0;
+}
+
+
+// done(job, n) returns true if shard n has been processed to its end
+bool done(const Job &job, int n) {
+    long offset;
+    long written;
+    return load_checkpoint(job, n, &offset, &written) && offset >= job.bounds[n + 1];
+}
+
+
+// process(task, line) returns the result line (without newline) of task for the
+//    input line line (without newline)
+std::string process(Task task, const char *line) {
+    char board[82];
+    Sudoku sud;
+
+    if (task == GENERATE) {
+        char *end;
+        long blanks = strtol(line, &end, 10);
+        if (end == line || *end != '\0' || blanks < 0 || blanks > 81) {
+            return "error blanks must be between 0 and 81";
+        }
+        int result = generate(&sud, blanks);
+        write_board(sud, board);
+        return std::to_string(result) + " " + std::string(board);
+    }
+
+    if (strlen(line) != 81 || !read_board(&sud, line)) {
+        return "error board must have 81 characters from 0-9 or .";
+    }
+
+    if (task == RATE) {
+        sud.set_heuristics(MRV_DEGREE, LEAST_CONSTRAINING); // no random choices
+        int solutions = sud.solve();
+        return std::to_string(solutions) + " " + std::to_string(sud.positions());
+    }
+
+    sud.set_heuristics(FEWEST_PLACES, RANDOM_START); // the solution shown is unique
+    int solutions = sud.solve();
+    if (solutions != 1) {
+        return std::to_string(solutions);
+    }
+    write_board(sud, board);
+    return "1 " + std::string(board);
+}
+
+
+// run_shard(job, n) processes the lines of shard n from its checkpoint (or its
+//    start) to its end, and returns an exit status
+int run_shard(const Job &job, int n) {
+    long offset = job.bounds[n];
+    long written = 0;
+    load_checkpoint(job, n, &offset, &written);
+    long end = job.bounds[n + 1];
+
+    // results past the checkpoint are dropped, their lines are processed again
+    std::string out_path = shard_path(job, n, ".out");
+    int fd = open(out_path.c_str(), O_WRONLY | O_CREAT, 0644);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!out || ftruncate(fd, written) != 0 || fseek(out, written, SEEK_SET) != 0) {
+        perror(out_path.c_str());
+        return 1;
+    }
+
+    FILE *in = fopen(job.input.c_str(), "r");
+    if (!in || fseek(in, offset, SEEK_SET) != 0) {
+        perror(job.input.c_str());
+        return 1;
+    }
+
+    char *line = NULL;
+    size_t capacity = 0;
+    int since = 0; // lines processed since the last checkpoint
+    bool ok = true;
+
+    while (ok && offset < end) {
+        ssize_t len = getline(&line, &capacity, in);
+        if (len <= 0) {
+            fprintf(stderr, "shard %d: %s ended early, has it changed?\n", n, job.input.c_str());
+            ok = false;
+            break;
+        }
+        offset += len;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+
+        std::string result = process(job.task, line) + "\n";
+        ok = fputs(result.c_str(), out) >= 0;
+        written += result.size();
+
+        if (ok && ++since == CHECKPOINT_LINES) {
+            since = 0;
+            ok = fflush(out) == 0 && fsync(fd) == 0 && save_checkpoint(job, n, offset, written);
+        }
+    }
+
+    // the last checkpoint marks the shard done (even an empty one)
+    ok = ok && fflush(out) == 0 && fsync(fd) == 0 && save_checkpoint(job, n, offset, written);
+    if (!ok) {
+        perror(out_path.c_str());
+    }
+
+    free(line);
+    fclose(in);
+    fclose(out);
+    return ok ? 0 : 1;
+}
+
+
+// merge(job) writes the results of every shard, in order, to the results file of
+//    job, replacing it at once. Returns false, after reporting why, if it fails.
+bool merge(const Job &job) {
+    char host[64] = "";
+    gethostname(host, sizeof host - 1);
+    std::string results = path(job, "results");
+    std::string tmp = results + ".tmp." + host + "." + std::to_string(getpid()); // parts may merge together
+
+    FILE *f = fopen(tmp.c_str(), "w");
+    bool ok = f != NULL;
+    char buf[1 << 16];
+
+    for (int n = 0; ok && n < job.shards; ++n) {
+        long offset;
+        long left; // bytes of results to copy
+        FILE *out = fopen(shard_path(job, n, ".out").c_str(), "r");
+        ok = out && load_checkpoint(job, n, &offset, &left);
+
+        while (ok && left > 0) {
+            size_t got = fread(buf, 1, left < (long) sizeof buf ? left : sizeof buf, out);
+            ok = got > 0 && fwrite(buf, 1, got, f) == got;
+            left -= got;
+        }
+        if (out) {
+            fclose(out);
+        }
+    }
+
+    if (f) {
+        ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+        ok = fclose(f) == 0 && ok;
+    }
+    ok = ok && rename(tmp.c_str(), results.c_str()) == 0;
+    if (!ok) {
+        perror(results.c_str());
+        remove(tmp.c_str());
+    }
+    return ok;
+}
+
+#endif
+
+} // namespace
+
+
+int shard_run(const char *task, const char *input, const char *dir, int shards,
+              int processes, int part, int parts) {
+#ifdef _WIN32
+    (void) task;
+    (void) input;
+    (void) dir;
+    (void) shards;
+    (void) processes;
+    (void) part;
+    (void) parts;
+    fprintf(stderr, "shard: not supported on this platform\n");
+    return 1;
+#else
+    Job job;
+    job.input = input;
+    job.dir = dir;
+    job.shards = shards;
+
+    int t = 0;
+    while (t < 3 && strcmp(task, TASKS[t]) != 0) {
+        ++t;
+    }
+    if (t == 3) {
+        fprintf(stderr, "shard: task must be solve, rate or generate\n");
+        return 1;
+    }
+    job.task = (Task) t;
+
+    FILE *in = fopen(input, "r");
+    struct stat st;
+    if (!in || fstat(fileno(in), &st) != 0) {
+        perror(input);
+        return 1;
+    }
+    long size = st.st_size;
+    for (int n = 0; n <= shards; ++n) {
+        job.bounds.push_back(line_start(in, (long) ((double) size * n / shards), size));
+    }
+    fclose(in);
+    for (int n = 0; n <= shards; ++n) {
+        if (job.bounds[n] < 0) {
+            perror(input);
+            return 1;
+        }
+    }
+
+    if (!open_job(job, size)) {
+        return 1;
+    }
+
+    std::vector<int> pending;
+    for (int n = part; n < shards; n += parts) {
+        if (!done(job, n)) {
+            pending.push_back(n);
+        }
+    }
+
+    if (processes == 0) {
+        processes = std::thread::hardware_concurrency();
+    }
+    if (processes < 1) {
+        processes = 1;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    // each shard draws its own random numbers
+    unsigned seed = rand();
+    fflush(stdout);
+    fflush(stderr);
+
+    size_t next = 0;
+    int running = 0;
+    int failed = 0;
+    while (next < pending.size() || running > 0) {
+        while (next < pending.size() && running < processes) {
+            int n = pending[next++];
+            pid_t pid = fork();
+            if (pid == 0) {
+                srand(seed + n);
+                _exit(run_shard(job, n));
+            }
+            if (pid < 0) {
+                perror("fork");
+                ++failed;
+            } else {
+                ++running;
+            }
+        }
+
+        int status;
+        if (running == 0) {
+            continue;
+        }
+        if (wait(&status) < 0) {
+            if (errno != EINTR) { // no children left to wait for
+                perror("wait");
+                failed += running;
+                running = 0;
+            }
+            continue;
+        }
+        --running;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++failed;
+        }
+    }
+
+    int finished = 0;
+    for (int n = 0; n < shards; ++n) {
+        finished += done(job, n);
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    fprintf(stderr, "ran %d shards in %.2f s (%d failed), %d of %d shards done\n",
+            (int) pending.size(), elapsed, failed, finished, shards);
+
+    if (failed > 0) {
+        fprintf(stderr, "shard: run the job again to resume the failed shards\n");
+        return 1;
+    }
+    if (finished == shards && !merge(job)) {
+        return 1;
+    }
+    return 0;
+#endif
+}
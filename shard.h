@@ -0,0 +1,43 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+// Sharded processing of large puzzle files, one process per shard, that can be
+//    resumed after a crash. The input file holds one item per line and is split
+//    into shards of about the same size (at line boundaries). The process of
+//    shard n writes one result line per input line to <dir>/shard-<n>.out, and
+//    every thousand lines syncs it to disk and records how far it got in
+//    <dir>/shard-<n>.ckpt. Running the same job again starts each shard from its
+//    checkpoint, dropping any results written after it, so an interrupted run
+//    only loses the work since the last checkpoint. Once every shard is done,
+//    their results are joined, in input order, into <dir>/results.
+//
+// Tasks (input line -> result line):
+//    solve     <board>    ->  <solutions> [<solution>]
+//    rate      <board>    ->  <solutions> <positions>
+//    generate  <blanks>   ->  <blanks> <puzzle>
+//    lines that can't be read give "error <message>"
+// with boards as in serve.h. The rating is the number of positions filled by a
+//    search without random choices while counting the solutions (see
+//    Sudoku::positions() in sudoku.h), so it is the same on every run.
+//
+// Several machines sharing dir (e.g. over NFS) split a job by running it with
+//    the same input and shard count, each with its own part: part k of m runs
+//    the shards n with n % m == k. The last one to finish writes the results.
+//
+// NOTE: like the rest of the module, the seed for rand() must be set first.
+//    The latencies of the shard processes are not recorded (see latency.h).
+
+// shard_run(task, input, dir, shards, processes, part, parts) runs the shards of
+//    part part of parts of the job applying task ("solve", "rate" or "generate")
+//    to the file at input in shards shards, processes of them at a time (0 runs
+//    one per core), keeping its files in dir (created if needed). Progress goes
+//    to stderr. Returns a non-zero exit status if task is unknown, dir holds
+//    another job, or a shard failed (running the job again resumes it), and
+//    always on Windows, where it is not supported.
+// requires: shards >= 1
+//           processes >= 0
+//           0 <= part < parts
+int shard_run(const char *task, const char *input, const char *dir, int shards,
+              int processes, int part, int parts);
+
+#endif // SHARD_H
@@ -1,25 +1,576 @@
+#include <algorithm>
 #include <ctime>
 #include <cstdlib>
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
 #include "sudoku.h"
+#include "latency.h"
+#include "table.h"
 
 // see sudoku.h for documentation
 
-Sudoku::Sudoku(): sol_count(-1) {
-    for (int i = 0; i < 9; ++i) {
-        for (int j = 0; j < 9; ++j) {
-            board[i][j] = 0;
-            poss[i][j][0] = 9;
-            for (int k = 1; k < 10; ++k) {
-                poss[i][j][k] = k;
+constexpr Variant CLASSIC; // built at compile time
+
+// where solve() and generate() record their latency, NULL if they don't
+LatencyRecorder *recorder = NULL;
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// ZobristKeys holds a random 64-bit key for each digit at each position
+//    (see Sudoku::zobrist), drawn with splitmix64 at compile time
+struct ZobristKeys {
+    uint64_t keys[81][10];
+
+    constexpr ZobristKeys(): keys() {
+        uint64_t state = 0x5D0C0B5EED5ULL;
+        for (int i = 0; i < 81; ++i) {
+            for (int v = 1; v <= 9; ++v) {
+                state += 0x9E3779B97F4A7C15ULL;
+                uint64_t x = state;
+                x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+                keys[i][v] = x ^ (x >> 31);
+            }
+        }
+    }
+};
+
+constexpr ZobristKeys ZOBRIST;
+
+const size_t CARVE_TABLE = 1 << 15; // entries of the table used while carving (256 KB)
+
+// blanks carve_exact() accepts: a puzzle with one solution has at least 17 clues
+const int MAX_BLANKS = 81 - 17;
+
+// removals carve_exact() tries in all before giving up (each is a uniqueness
+//    solve, this is a few seconds)
+const long CARVE_TRIES = 1 << 14;
+
+// next_random(state) advances the xorshift32 generator with the given state
+//    and returns its next number
+// requires: *state != 0
+uint32_t next_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+// thread_random(n) returns a random number from 0 to n - 1 from the generator
+//    of the calling thread, seeded with rand() on its first use
+// requires: n >= 1
+int thread_random(int n) {
+    static thread_local uint32_t state = (uint32_t) rand() * 2 + 1; // never 0
+    return next_random(&state) % n;
+}
+
+// number of solve() and generate() calls in progress on this thread, so that the
+//    solves done inside generate() (or inside a solve) are not recorded
+thread_local int timed_depth = 0;
+
+// board_cells(sud, cells) copies sud.board into cells
+void board_cells(const Sudoku &sud, char *cells) {
+    const int *board = sud.board[0];
+    for (int i = 0; i < 81; ++i) {
+        cells[i] = board[i];
+    }
+}
+
+
+// sum_reachable(remaining, left, used) returns true if left more cells can hold
+//    different digits, none of them in the bitmask used, adding up to remaining
+bool sum_reachable(int remaining, int left, int used) {
+    int low = 0;
+    int high = 0;
+    int n = 0;
+    for (int d = 1; d <= 9 && n < left; ++d) { // the smallest free digits
+        if (!(used & (1 << d))) {
+            low += d;
+            ++n;
+        }
+    }
+    if (n < left) { // not enough free digits
+        return false;
+    }
+
+    n = 0;
+    for (int d = 9; d >= 1 && n < left; --d) { // the largest free digits
+        if (!(used & (1 << d))) {
+            high += d;
+            ++n;
+        }
+    }
+
+    return low <= remaining && remaining <= high;
+}
+
+
+// luby(i) returns the i-th term (from 1) of the Luby sequence 1 1 2 1 1 2 4 1 1 2 ...
+long luby(int i) {
+    int k = 1;
+    while ((1 << k) - 1 < i) { // the block of length 2^k - 1 containing i
+        ++k;
+    }
+
+    if (i == (1 << k) - 1) {
+        return 1L << (k - 1);
+    }
+    return luby(i - (1 << (k - 1)) + 1);
+}
+
+
+// UnavoidableSets holds small unavoidable sets of a full grid: groups of cells
+//    that can be refilled differently to get another valid grid. A puzzle with
+//    that solution must keep at least one clue in each of them, otherwise it
+//    has several solutions. The sets are found for every pair of digits a, b:
+//    each cell holding a is tied to the cells holding b in its row, column and
+//    3x3 grid (and vice versa), and every connected group can have its a and b
+//    swapped. More sets are learned from the second solutions found by carve().
+struct UnavoidableSets {
+    static const int MAXSETS = 512;
+    static const int MAXSIZE = 12;     // bigger digit-pair sets rarely block a removal
+    static const int MAXPERCELL = 32;
+
+    int count;
+    int clues[MAXSETS]; // clues left in each set
+    int size[MAXSETS];
+    unsigned char members[MAXSETS][81];
+
+    // the sets containing each cell
+    int cell_count[81];
+    int cell_sets[81][MAXPERCELL];
+
+    // add(cells, size, board) adds the set of size cells listed in cells, counting
+    //    its clues in board. Does nothing if there is no room left.
+    void add(const int *cells, int size, const int *board) {
+        if (count == MAXSETS) {
+            return;
+        }
+        for (int k = 0; k < size; ++k) {
+            if (cell_count[cells[k]] == MAXPERCELL) {
+                return;
+            }
+        }
+
+        clues[count] = 0;
+        for (int k = 0; k < size; ++k) {
+            int cell = cells[k];
+            cell_sets[cell][cell_count[cell]++] = count;
+            clues[count] += board[cell] != 0;
+            members[count][k] = cell;
+        }
+        this->size[count] = size;
+        ++count;
+    }
+
+    // find(grid, board) finds the sets of the full grid, and counts their clues
+    //    in board
+    void find(const int *grid, const int *board) {
+        count = 0;
+        for (int i = 0; i < 81; ++i) {
+            cell_count[i] = 0;
+        }
+
+        // where[d][u] is the cell holding d in unit u (rows, columns, 3x3 grids)
+        int where[10][27];
+        for (int i = 0; i < 81; ++i) {
+            int r = i / 9;
+            int c = i % 9;
+            where[grid[i]][r] = i;
+            where[grid[i]][9 + c] = i;
+            where[grid[i]][18 + 3*(r/3) + c/3] = i;
+        }
+
+        for (int a = 1; a <= 9; ++a) {
+            for (int b = a + 1; b <= 9; ++b) {
+                int group[81]; // union-find over the 18 cells holding a or b
+                for (int d = a; d <= b; d += b - a) {
+                    for (int r = 0; r < 9; ++r) {
+                        group[where[d][r]] = where[d][r];
+                    }
+                }
+
+                for (int u = 0; u < 27; ++u) {
+                    join(group, where[a][u], where[b][u]);
+                }
+
+                for (int r = 0; r < 18; ++r) { // one set per root
+                    int root = where[r < 9 ? a : b][r % 9];
+                    if (top(group, root) != root) {
+                        continue;
+                    }
+
+                    int cells[18];
+                    int size = 0;
+                    for (int d = a; d <= b; d += b - a) {
+                        for (int k = 0; k < 9; ++k) {
+                            if (top(group, where[d][k]) == root) {
+                                cells[size++] = where[d][k];
+                            }
+                        }
+                    }
+                    if (size <= MAXSIZE) {
+                        add(cells, size, board);
+                    }
+                }
+            }
+        }
+    }
+
+    // blocks(idx) returns true if removing the clue at idx empties a set
+    bool blocks(int idx) const {
+        for (int k = 0; k < cell_count[idx]; ++k) {
+            if (clues[cell_sets[idx][k]] == 1) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // removed(idx) records that the clue at idx was removed
+    void removed(int idx) {
+        for (int k = 0; k < cell_count[idx]; ++k) {
+            --clues[cell_sets[idx][k]];
+        }
+    }
+
+    // packing(board, fixed) returns a number of sets whose clues on board are all
+    //    outside fixed, with no clue in common: each needs one of those clues kept,
+    //    so at least that many of the clues outside fixed must stay
+    int packing(const int *board, const uint64_t *fixed) const {
+        uint64_t used[2] = {fixed[0], fixed[1]};
+        int n = 0;
+
+        for (int g = 0; g < count; ++g) {
+            bool free = clues[g] > 0;
+            for (int k = 0; k < size[g] && free; ++k) {
+                int cell = members[g][k];
+                free = board[cell] == 0 || !(used[cell / 64] & (1ULL << (cell % 64)));
+            }
+            if (!free) {
+                continue;
+            }
+
+            for (int k = 0; k < size[g]; ++k) {
+                int cell = members[g][k];
+                if (board[cell] != 0) {
+                    used[cell / 64] |= 1ULL << (cell % 64);
+                }
+            }
+            ++n;
+        }
+
+        return n;
+    }
+
+    // restored(idx) records that the clue at idx was put back
+    void restored(int idx) {
+        for (int k = 0; k < cell_count[idx]; ++k) {
+            ++clues[cell_sets[idx][k]];
+        }
+    }
+
+    // top(group, i) returns the representative of the group containing i
+    static int top(int *group, int i) {
+        while (group[i] != i) {
+            group[i] = group[group[i]];
+            i = group[i];
+        }
+        return i;
+    }
+
+    // join(group, i, j) merges the groups containing i and j
+    static void join(int *group, int i, int j) {
+        group[top(group, i)] = top(group, j);
+    }
+};
+
+} // namespace
+
+
+// Nogoods holds the combinations of guesses (position, digit) that learn_sol()
+//    found to lead to no solution, during one search. Combinations are stored
+//    as lists of placements, and indexed by each of their placements, so that
+//    a new placement only has to be checked against the ones containing it.
+//    Only small combinations are kept: they cut the most branches.
+struct Nogoods {
+    static const int MAXGOODS = 4096;
+    static const int MAXSIZE = 8;
+    static const int MAXPERPLACE = 32;
+
+    int count;
+    int size[MAXGOODS];
+    unsigned char cells[MAXGOODS][MAXSIZE];
+    unsigned char vals[MAXGOODS][MAXSIZE];
+
+    // the combinations containing each placement
+    int place_count[81][10];
+    int place_goods[81][10][MAXPERPLACE];
+
+    // depth of the guess that filled each position, 0 for empty ones and clues
+    int level[81];
+
+    Nogoods(): count(0) {
+        for (int i = 0; i < 81; ++i) {
+            level[i] = 0;
+            for (int v = 0; v < 10; ++v) {
+                place_count[i][v] = 0;
+            }
+        }
+    }
+
+    // guesses(conflict) stores every guessed position in conflict
+    void guesses(uint64_t *conflict) const {
+        conflict[0] = 0;
+        conflict[1] = 0;
+        for (int i = 0; i < 81; ++i) {
+            if (level[i] > 0) {
+                conflict[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+
+    // explain(sud, idx, val, conflict) adds to conflict the earliest guess that
+    //    ruled val out of the empty position idx (nothing if a clue did). Returns
+    //    false if no position sharing a unit with idx holds val, so its cage did.
+    bool explain(const Sudoku &sud, int idx, int val, uint64_t *conflict) const {
+        const int *board = sud.board[0];
+        const unsigned char *peers = sud.variant->peers[idx];
+        int count = sud.variant->peer_count[idx];
+
+        int first = -1;
+        for (int i = 0; i < count; ++i) {
+            int p = peers[i];
+            if (board[p] == val && (first == -1 || level[p] < level[first])) {
+                first = p;
+            }
+        }
+
+        if (first != -1 && level[first] > 0) {
+            conflict[first / 64] |= 1ULL << (first % 64);
+        }
+        return first != -1;
+    }
+
+    // explain_cage(sud, idx, conflict) adds to conflict the guesses in the cage
+    //    containing idx, which together rule a digit out of idx
+    void explain_cage(const Sudoku &sud, int idx, uint64_t *conflict) const {
+        const int *board = sud.board[0];
+        int u = sud.variant->sum_unit[idx];
+
+        for (int k = 0; k < sud.variant->unit_size[u]; ++k) {
+            int cell = sud.variant->units[u][k];
+            if (board[cell] != 0 && level[cell] > 0) {
+                conflict[cell / 64] |= 1ULL << (cell % 64);
+            }
+        }
+    }
+
+    // add(board, conflict) records the digits board holds at the positions in
+    //    conflict as a combination. Does nothing if it is too big or there is no room.
+    void add(const int *board, const uint64_t *conflict) {
+        int n = __builtin_popcountll(conflict[0]) + __builtin_popcountll(conflict[1]);
+        if (n == 0 || n > MAXSIZE || count == MAXGOODS) {
+            return;
+        }
+
+        int k = 0;
+        for (int w = 0; w < 2; ++w) {
+            for (uint64_t bits = conflict[w]; bits != 0; bits &= bits - 1) {
+                int cell = 64*w + __builtin_ctzll(bits);
+                if (place_count[cell][board[cell]] == MAXPERPLACE) {
+                    return;
+                }
+                cells[count][k] = cell;
+                vals[count][k] = board[cell];
+                ++k;
+            }
+        }
+
+        size[count] = n;
+        for (k = 0; k < n; ++k) {
+            int cell = cells[count][k];
+            int val = vals[count][k];
+            place_goods[cell][val][place_count[cell][val]++] = count;
+        }
+        ++count;
+    }
+
+    // hit(board, idx, val, conflict) returns true if placing val at idx completed
+    //    a recorded combination on board, and stores its positions in conflict
+    bool hit(const int *board, int idx, int val, uint64_t *conflict) const {
+        for (int j = 0; j < place_count[idx][val]; ++j) {
+            int g = place_goods[idx][val][j];
+            int k = 0;
+            while (k < size[g] && board[cells[g][k]] == vals[g][k]) {
+                ++k;
             }
+            if (k == size[g]) {
+                for (k = 0; k < size[g]; ++k) {
+                    conflict[cells[g][k] / 64] |= 1ULL << (cells[g][k] % 64);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+bool Variant::add_unit(const int *cells, int size) {
+    if (unit_count == MAXUNITS) {
+        return false;
+    }
+    for (int i = 0; i < size && size == 9; ++i) {
+        if (full_count[cells[i]] == MAXFULL) {
+            return false;
         }
     }
+
+    for (int i = 0; i < size; ++i) {
+        units[unit_count][i] = cells[i];
+    }
+    unit_size[unit_count] = size;
+    unit_sum[unit_count] = 0;
+    ++unit_count;
+
+    update();
+    return true;
+}
+
+
+bool Variant::add_diagonals() {
+    // the center is on both diagonals, so it would be in 7 units the second time
+    if (unit_count + 2 > MAXUNITS || full_count[40] + 2 > MAXFULL) {
+        return false;
+    }
+
+    int down[9]; // top-left to bottom-right
+    int up[9];   // top-right to bottom-left
+    for (int i = 0; i < 9; ++i) {
+        down[i] = 10*i;
+        up[i] = 8*i + 8;
+    }
+    return add_unit(down, 9) && add_unit(up, 9);
+}
+
+
+bool Variant::set_regions(const int *regions) {
+    int count[9] = {0};
+    for (int i = 0; i < 81; ++i) {
+        ++count[regions[i]];
+    }
+    for (int g = 0; g < 9; ++g) {
+        if (count[g] != 9) {
+            return false;
+        }
+    }
+
+    for (int g = 0; g < 9; ++g) {
+        unit_size[18 + g] = 0;
+    }
+    for (int i = 0; i < 81; ++i) {
+        int u = 18 + regions[i];
+        units[u][unit_size[u]++] = i;
+    }
+
+    update();
+    return true;
+}
+
+
+bool Variant::add_cage(const int *cells, int size, int sum) {
+    for (int i = 0; i < size; ++i) {
+        if (sum_unit[cells[i]] != -1) {
+            return false;
+        }
+    }
+    if (!add_unit(cells, size)) {
+        return false;
+    }
+
+    unit_sum[unit_count - 1] = sum;
+    update(); // again, for sum_unit
+    return true;
+}
+
+
+Sudoku::Sudoku(): variant(&CLASSIC), sol_count(-1), branching(RANDOM_MRV),
+                  value_order(RANDOM_START), stop(NULL), learning(false), rng(0),
+                  restart_unit(0), table(NULL), nodes(0), limit(0) {
+    clear();
+}
+
+
+Sudoku::Sudoku(const Variant *var): variant(var), sol_count(-1), branching(RANDOM_MRV),
+                                    value_order(RANDOM_START), stop(NULL), learning(false),
+                                    rng(0), restart_unit(0), table(NULL), nodes(0), limit(0) {
+    clear();
+}
+
+
+void Sudoku::set_heuristics(Branching branching, ValueOrder order) {
+    this->branching = branching;
+    value_order = order;
+}
+
+
+void Sudoku::set_stop(const std::atomic<bool> *flag) {
+    stop = flag;
+}
+
+
+void Sudoku::set_learning(bool on) {
+    learning = on;
+}
+
+
+void Sudoku::set_table(TranspositionTable *table) {
+    this->table = table;
+}
+
+
+void Sudoku::set_seed(uint32_t seed) {
+    rng = seed;
+}
+
+
+void Sudoku::set_restarts(int unit) {
+    restart_unit = unit;
+}
+
+
+long Sudoku::positions() const {
+    return nodes;
+}
+
+
+int Sudoku::random(int n) {
+    if (rng == 0) {
+        return thread_random(n);
+    }
+    return next_random(&rng) % n;
+}
+
+
+bool Sudoku::halted() {
+    if (stop && stop->load(std::memory_order_relaxed)) {
+        return true;
+    }
+    ++nodes;
+    return limit != 0 && nodes > limit;
 }
 
 
 void Sudoku::clear() {
-    sol_count = -1;
     for (int i = 0; i < 9; ++i) {
         for (int j = 0; j < 9; ++j) {
             board[i][j] = 0;
@@ -29,48 +580,144 @@ void Sudoku::clear() {
             }
         }
     }
+
+    for (int n = 0; n < 10; ++n) {
+        by_poss[n][0] = 0;
+        by_poss[n][1] = 0;
+    }
+    by_poss[9][0] = ~0ULL; // positions 0-63
+    by_poss[9][1] = (1ULL << 17) - 1; // positions 64-80
+
+    for (int i = 0; i < 81; ++i) {
+        empty_peers[i] = variant->peer_count[i];
+    }
+
+    for (int u = 0; u < variant->unit_count; ++u) {
+        for (int v = 1; v <= 9; ++v) {
+            places[u][v] = variant->unit_size[u];
+            held[u][v] = 0;
+        }
+    }
+
+    for (int u = 0; u < variant->unit_count; ++u) {
+        if (variant->unit_sum[u] != 0) {
+            update_cage(u);
+        }
+    }
+
+    zobrist = 0;
+}
+
+
+void Sudoku::set_count(int idx, int n) {
+    int *p = poss[idx / 9][idx % 9];
+    uint64_t bit = 1ULL << (idx % 64);
+
+    if (p[0] != -1) {
+        by_poss[p[0]][idx / 64] &= ~bit;
+    }
+    if (n != -1) {
+        by_poss[n][idx / 64] |= bit;
+    }
+    p[0] = n;
+}
+
+
+void Sudoku::drop_place(int idx, int val) {
+    int *p = poss[idx / 9][idx % 9];
+    p[val] = 0;
+    set_count(idx, p[0] - 1);
+
+    const unsigned char *units = variant->full_units[idx];
+    for (int k = 0, count = variant->full_count[idx]; k < count; ++k) {
+        --places[units[k]][val];
+    }
+}
+
+
+void Sudoku::move_places(int idx, int before, int after) {
+    const unsigned char *units = variant->full_units[idx];
+    int count = variant->full_count[idx];
+    for (int changed = before ^ after; changed != 0; changed &= changed - 1) {
+        int v = __builtin_ctz(changed);
+        int delta = (after >> v & 1) ? 1 : -1;
+        for (int k = 0; k < count; ++k) {
+            places[units[k]][v] += delta;
+        }
+    }
 }
 
 
 void Sudoku::insert(int row, int col, int val) {
+    int idx = 9*row + col;
+    int old = board[row][col];
+    bool was_empty = old == 0;
+
+    zobrist ^= ZOBRIST.keys[idx][old] ^ ZOBRIST.keys[idx][val];
     board[row][col] = val;
 
-    for (int i = 0; i < 9; ++i) {
-        if (poss[row][i][val] != 0) {
-            poss[row][i][val] = 0;
-            if (poss[row][i][0] > 0) {
-                --poss[row][i][0];
+    const unsigned char *peers = variant->peers[idx];
+    int count = variant->peer_count[idx];
+    for (int i = 0; i < count; ++i) {
+        int *p = poss[peers[i] / 9][peers[i] % 9];
+        if (p[val] != 0) {
+            if (p[0] > 0) {
+                drop_place(peers[i], val);
+            } else {
+                p[val] = 0; // a filled position, not counted
             }
         }
-
-        if (poss[i][col][val] != 0) {
-            poss[i][col][val] = 0;
-            if (poss[i][col][0] > 0) {
-                --poss[i][col][0];
-            }
+        if (was_empty) {
+            --empty_peers[peers[i]];
         }
+    }
 
-        if (poss[3*(row/3) + i%3][3*(col/3) + i/3][val] != 0) {
-            poss[3*(row/3) + i%3][3*(col/3) + i/3][val] = 0;
-            if (poss[3*(row/3) + i%3][3*(col/3) + i/3][0] > 0) {
-                --poss[3*(row/3) + i%3][3*(col/3) + i/3][0];
-            }
+    if (poss[row][col][0] != -1) { // its possibilities no longer count as places
+        move_places(idx, candidates(row, col), 0);
+    }
+    const unsigned char *units = variant->full_units[idx];
+    for (int k = 0, full = variant->full_count[idx]; k < full; ++k) {
+        int u = units[k];
+        if (!was_empty) {
+            --held[u][old];
         }
+        ++held[u][val];
     }
 
-    poss[row][col][0] = -1;
+    poss[row][col][val] = 0;
+    set_count(idx, -1);
+
+    int u = variant->sum_unit[idx];
+    if (u != -1) {
+        update_cage(u);
+    }
 }
 
 
 int Sudoku::remove(int row, int col) {
+    int idx = 9*row + col;
     int val = board[row][col];
 
+    zobrist ^= ZOBRIST.keys[idx][val];
     board[row][col] = 0;
+    const unsigned char *units = variant->full_units[idx];
+    for (int k = 0, full = variant->full_count[idx]; k < full; ++k) {
+        --held[units[k]][val];
+    }
 
-    for (int i = 0; i < 9; ++i) {
-        fill_poss(row, i);
-        fill_poss(i, col);
-        fill_poss(3*(row/3) + i%3, 3*(col/3) + i/3);
+    int u = variant->sum_unit[idx];
+    if (u != -1) { // its positions are all peers, so they are refilled below
+        cage_allowed[u] = cage_digits(u);
+    }
+
+    fill_poss(idx);
+    const unsigned char *peers = variant->peers[idx];
+    int count = variant->peer_count[idx];
+    for (int i = 0; i < count; ++i) {
+        fill_poss(peers[i]);
+        if (val != 0) {
+            ++empty_peers[peers[i]];
+        }
     }
 
     return val;
@@ -78,44 +725,29 @@ int Sudoku::remove(int row, int col) {
 
 
 bool Sudoku::valid() const {
-    for (int i = 0; i < 9; ++i) {
-        int row[9] = {0};
-        int col[9] = {0};
-        int sqr[9] = {0};
+    const int *cells = board[0];
 
-        int y = 3 * (i/3); // loops through the top-left position
-        int x = 3 * (i%3); //    of each of the 9 3x3 grids
+    for (int u = 0; u < variant->unit_count; ++u) {
+        int seen = 0; // bit v is set once v has been found in the unit
+        int sum = 0;
+        int left = 0;
+        const unsigned char *unit = variant->units[u];
 
-        for (int j = 0; j < 9; ++j) {
-
-            int val = board[i][j];
+        for (int i = 0; i < variant->unit_size[u]; ++i) {
+            int val = cells[unit[i]];
             if (val != 0) {
-                if (row[val - 1] != 0) {
+                if (seen & (1 << val)) {
                     return false;
-                } else {
-                    row[val - 1] = 1;
-                }
-            }
-
-            val = board[j][i];
-            if (val != 0) {
-                if (col[val - 1] != 0) {
-                   return false;
-                } else {
-                    col[val - 1] = 1;
                 }
+                seen |= 1 << val;
+                sum += val;
+            } else {
+                ++left;
             }
+        }
 
-            // loops through the 9 positions of the current
-            //    3x3 square (starting at (y, x))
-            val = board[y + (j/3)][x + (j%3)];
-            if (val != 0) {
-                if (sqr[val - 1] != 0) {
-                    return false;
-                } else {
-                    sqr[val - 1] = 1;
-                }
-            }
+        if (variant->unit_sum[u] != 0 && !sum_reachable(variant->unit_sum[u] - sum, left, seen)) {
+            return false;
         }
     }
 
@@ -123,29 +755,249 @@ bool Sudoku::valid() const {
 }
 
 
+int Sudoku::candidates(int row, int col) const {
+    const int *p = poss[row][col];
+    if (p[0] == -1) {
+        return 0;
+    }
+
+    int mask = 0;
+    for (int v = 1; v <= 9; ++v) {
+        if (p[v] != 0) {
+            mask |= 1 << v;
+        }
+    }
+    return mask;
+}
+
+
+int Sudoku::cage_digits(int u) const {
+    const int *cells = board[0];
+    int used = 0;
+    int sum = 0;
+    int left = 0;
+    for (int i = 0; i < variant->unit_size[u]; ++i) {
+        int val = cells[variant->units[u][i]];
+        if (val != 0) {
+            used |= 1 << val;
+            sum += val;
+        } else {
+            ++left;
+        }
+    }
+
+    int digits = 0;
+    for (int v = 1; v <= 9 && left > 0; ++v) {
+        if (!(used & (1 << v)) &&
+                sum_reachable(variant->unit_sum[u] - sum - v, left - 1, used | (1 << v))) {
+            digits |= 1 << v;
+        }
+    }
+    return digits;
+}
+
+
+void Sudoku::update_cage(int u) {
+    const int *cells = board[0];
+    int digits = cage_digits(u);
+    cage_allowed[u] = digits;
+
+    for (int i = 0; i < variant->unit_size[u]; ++i) {
+        int idx = variant->units[u][i];
+        int *p = poss[idx / 9][idx % 9];
+        if (cells[idx] != 0) {
+            continue;
+        }
+
+        for (int v = 1; v <= 9; ++v) {
+            if (p[v] != 0 && !(digits & (1 << v))) {
+                drop_place(idx, v);
+            }
+        }
+    }
+}
+
+
 int Sudoku::solve() {
+    if (!recorder || timed_depth > 0) {
+        return count_solutions();
+    }
+
+    char input[81];
+    board_cells(*this, input);
+
+    ++timed_depth;
+    Clock::time_point start = Clock::now();
+    int result = count_solutions();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    --timed_depth;
+
+    recorder->solve_times.record(ns);
+    recorder->slow_solves.offer(ns, input);
+    return result;
+}
+
+
+int Sudoku::count_solutions() {
     if (!valid()) {
         return 0;
     }
 
+    if (restart_unit == 0) {
+        return count_once();
+    }
+
+    Sudoku start(*this);
+    for (int run = 1; ; ++run) {
+        limit = luby(run) * restart_unit;
+        int result = count_once();
+        limit = 0;
+
+        if (result != -1 || (stop && stop->load(std::memory_order_relaxed))) {
+            return result;
+        }
+
+        uint32_t draws = rng; // start over, with the next random choices
+        *this = start;
+        rng = draws;
+    }
+}
+
+
+int Sudoku::count_once() {
+    nodes = 0;
     sol_count = 0;
-    find_sol();
+    search();
     int result = sol_count;
-
     sol_count = -1;
+
+    if (limit != 0 && nodes > limit) {
+        return -1;
+    }
+
     if (result == 1) {
-        find_sol();
+        long counted = nodes;
+        limit = 0; // the search that found it took less
+        search();
+        nodes = counted; // positions() reports the counting search only
     }
 
+    if (stop && stop->load(std::memory_order_relaxed)) {
+        return -1;
+    }
     return result;
 }
 
 
-bool Sudoku::find_sol() {
+bool Sudoku::search() {
+    if (!learning) {
+        return find_sol();
+    }
+
+    Nogoods *learned = new Nogoods;
+    uint64_t conflict[2];
+    bool result = learn_sol(learned, 1, conflict);
+    delete learned;
+    return result;
+}
+
+
+bool Sudoku::learn_sol(Nogoods *learned, int depth, uint64_t *conflict) {
+    if (halted()) {
+        return true;
+    }
+
+    int idx = 0;
+    if (!find_best_cell(&idx, true)) { // every position is filled
+        if (sol_count == -1) {
+            return true;
+        }
+        ++sol_count;
+        limit = 0; // ruling out others needs a complete search, restarting can't help
+        if (sol_count >= 2) {
+            return true;
+        }
+        learned->guesses(conflict); // keep looking, trying every guess in turn
+        return false;
+    }
+
+    int r = idx / 9;
+    int c = idx % 9;
+
+    int vals[9];
+    int n = 0;
+    if (value_order == LEAST_CONSTRAINING) {
+        n = least_constraining(idx, vals);
+    } else {
+        int rd = random(9) + 1;
+        for (int i = 0; i < 9; ++i) {
+            if (poss[r][c][rd] != 0) {
+                vals[n++] = rd;
+            }
+            rd = rd % 9 + 1;
+        }
+    }
+
+    // why the digits that can't go here are ruled out
+    uint64_t reasons[2] = {0, 0};
+    for (int v = 1; v <= 9; ++v) {
+        if (poss[r][c][v] == 0 && !learned->explain(*this, idx, v, reasons)) {
+            learned->explain_cage(*this, idx, reasons);
+        }
+    }
+
+    int found = sol_count;
+    uint64_t bit = 1ULL << (idx % 64);
+    for (int i = 0; i < n; ++i) {
+        insert(r, c, vals[i]);
+        learned->level[idx] = depth;
+
+        uint64_t below[2] = {0, 0};
+        if (!learned->hit(board[0], idx, vals[i], below) && learn_sol(learned, depth + 1, below)) {
+            return true;
+        }
+
+        remove(r, c);
+        learned->level[idx] = 0;
+
+        if (!(below[idx / 64] & bit)) { // this guess played no part, skip the others
+            conflict[0] = below[0];
+            conflict[1] = below[1];
+            return false;
+        }
+        below[idx / 64] &= ~bit;
+        reasons[0] |= below[0];
+        reasons[1] |= below[1];
+    }
+
+    conflict[0] = reasons[0];
+    conflict[1] = reasons[1];
+    if (sol_count == found) {
+        learned->add(board[0], conflict);
+    }
+    return false;
+}
+
+
+bool Sudoku::find_sol() {
+    if (halted()) {
+        return true; // unwind without looking further
+    }
+
     int r = 0;
     int c = 0;
+    bool found;
+
+    if (branching == RANDOM_MRV) {
+        found = find_least_poss(&r, &c);
+    } else {
+        int idx = 0;
+        found = find_best_cell(&idx, true);
+        r = idx / 9;
+        c = idx % 9;
+    }
 
-    if (!find_least_poss(&r, &c)) { // base case - no more possibilities
+    if (!found) { // base case - no more possibilities
         if (!sudoku_filled()) { // sudoku is not full, thus this solution is invalid
             return false;
         } // sudoku is full, so a solution has been found
@@ -155,6 +1007,7 @@ bool Sudoku::find_sol() {
         } // counting solutions
 
         ++sol_count; // add to the count of solutions
+        limit = 0; // ruling out others needs a complete search, restarting can't help
 
         if (sol_count >= 2) {
             return true; // found multiple solutions, can return
@@ -163,15 +1016,55 @@ bool Sudoku::find_sol() {
         }
     }
 
-    return find_sol_pos(r, c); // recursive step - try filling position r, c
+    int before = sol_count;
+    if (table) {
+        int count;
+        if (table->find(zobrist, &count)) {
+            if (count == 0) { // searched before, a dead end
+                return false;
+            }
+            if (sol_count == 0) { // its solution is the first, board isn't needed yet
+                sol_count = 1;
+                return false;
+            }
+        }
+    }
+
+    bool done;
+    int u = 0;
+    int val = 0;
+    if (branching == FEWEST_PLACES && poss[r][c][0] > 1 &&
+            find_fewest_places(&u, &val) < poss[r][c][0]) {
+        done = find_sol_unit(u, val); // recursive step - try each place for val
+    } else {
+        done = find_sol_pos(r, c); // recursive step - try filling position r, c
+    }
+
+    if (table && !done) { // searched completely
+        table->store(zobrist, sol_count == -1 ? 0 : sol_count - before);
+    }
+    return done;
 }
 
 
 bool Sudoku::find_sol_pos(int r, int c) {
+    if (value_order == LEAST_CONSTRAINING) {
+        int vals[9];
+        int n = least_constraining(9*r + c, vals);
+        for (int i = 0; i < n; ++i) {
+            insert(r, c, vals[i]);
+            if (find_sol() == true) {
+                return true;
+            }
+            remove(r, c);
+        }
+        return false;
+    }
+
     // rd is the first number we try to add to position (r, c)
     // this is done so that filling the sudoku is random
 
-    int rd = rand() % 9 + 1;
+    int rd = random(9) + 1;
 
     for (int i = 1; i <= 9; ++i) {
         if (poss[r][c][rd] != 0) { // rd is a possibility
@@ -191,20 +1084,153 @@ bool Sudoku::find_sol_pos(int r, int c) {
 }
 
 
-bool Sudoku::sudoku_filled() const {
-    for (int i = 0; i < 9; ++i) {
-        for (int j = 0; j < 9; ++j) {
-            if (board[j][i] == 0) {
-                return false;
+bool Sudoku::find_sol_unit(int u, int val) {
+    for (int k = 0; k < 9; ++k) {
+        int idx = variant->units[u][k];
+        int r = idx / 9;
+        int c = idx % 9;
+        if (board[r][c] == 0 && poss[r][c][val] != 0) {
+            insert(r, c, val);
+            if (find_sol() == true) {
+                return true;
+            }
+            remove(r, c);
+        }
+    }
+
+    return false; // val fits nowhere else in the unit
+}
+
+
+int Sudoku::least_constraining(int idx, int *vals) const {
+    const int *cell = poss[idx / 9][idx % 9];
+    const unsigned char *peers = variant->peers[idx];
+    int count = variant->peer_count[idx];
+
+    int n = 0;
+    int cost[10];
+    for (int v = 1; v <= 9; ++v) {
+        if (cell[v] == 0) {
+            continue;
+        }
+
+        cost[v] = 0; // empty peers that would lose v
+        for (int i = 0; i < count; ++i) {
+            const int *p = poss[peers[i] / 9][peers[i] % 9];
+            if (p[0] != -1 && p[v] != 0) {
+                ++cost[v];
+            }
+        }
+
+        int j = n++; // insertion sort, stable so lower digits win ties
+        while (j > 0 && cost[vals[j - 1]] > cost[v]) {
+            vals[j] = vals[j - 1];
+            --j;
+        }
+        vals[j] = v;
+    }
+
+    return n;
+}
+
+
+Solutions::Solutions(const Sudoku &start): sud(start.variant), started(false),
+                                             done(false), depth(0) {
+    sud.copy(start);
+}
+
+
+const Sudoku &Solutions::current() const {
+    return sud;
+}
+
+
+bool Solutions::step() {
+    int f = depth - 1;
+    int r = cell[f] / 9;
+    int c = cell[f] % 9;
+
+    if (digit[f] != 0) {
+        sud.remove(r, c);
+    }
+
+    for (int d = digit[f] + 1; d <= 9; ++d) {
+        if (sud.poss[r][c][d] != 0) {
+            sud.insert(r, c, d);
+            digit[f] = d;
+            return true;
+        }
+    }
+
+    --depth; // no digit left for this cell
+    return false;
+}
+
+
+bool Solutions::backtrack() {
+    while (depth > 0) {
+        if (step()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool Solutions::next() {
+    if (done) {
+        return false;
+    }
+
+    if (!started) {
+        started = true;
+        if (!sud.valid()) {
+            done = true;
+            return false;
+        }
+    } else if (!backtrack()) { // leave the previous solution
+        done = true;
+        return false;
+    }
+
+    for (;;) {
+        // the empty cell with the fewest possibilities (the first one on ties)
+        int best = 0;
+        if (!sud.find_best_cell(&best, false)) { // every cell is filled
+            return true;
+        }
+
+        if (sud.poss[best / 9][best % 9][0] != 0) {
+            cell[depth] = best;
+            digit[depth] = 0;
+            ++depth;
+            if (step()) {
+                continue;
             }
         }
+
+        if (!backtrack()) { // dead end, and nothing left to try
+            done = true;
+            return false;
+        }
+    }
+}
+
+
+bool Sudoku::sudoku_filled() const {
+    const int *cells = board[0];
+
+    for (int i = 0; i < 81; ++i) {
+        if (cells[i] == 0) {
+            return false;
+        }
     }
 
     return true;
 }
 
 
-bool Sudoku::find_least_poss(int *row, int *col) const {
+bool Sudoku::find_least_poss(int *row, int *col) {
     int min_poss = 10;
 
     for (int r = 0; r < 9; ++r) {
@@ -213,7 +1239,7 @@ bool Sudoku::find_least_poss(int *row, int *col) const {
 
                 // if number of possibilities is equal to the min, then we skip it
                 //     half of the time (makes solution for random)
-                if (poss[r][c][0] == min_poss && rand() % 2 == 0) {
+                if (poss[r][c][0] == min_poss && random(2) == 0) {
                     continue;
                 }
 
@@ -232,77 +1258,398 @@ bool Sudoku::find_least_poss(int *row, int *col) const {
 }
 
 
-void Sudoku::fill_poss(int r, int c) {
-    poss[r][c][0] = 9;
-    for (int i = 1; i <= 9; ++i) {
-        poss[r][c][i] = i;
+bool Sudoku::find_best_cell(int *idx, bool degree) const {
+    for (int n = 0; n <= 9; ++n) {
+        const uint64_t *group = by_poss[n];
+        if ((group[0] | group[1]) == 0) {
+            continue;
+        }
+
+        if (!degree) {
+            *idx = group[0] != 0 ? __builtin_ctzll(group[0]) : 64 + __builtin_ctzll(group[1]);
+            return true;
+        }
+
+        int best = -1;
+        for (int w = 0; w < 2; ++w) {
+            for (uint64_t bits = group[w]; bits != 0; bits &= bits - 1) {
+                int i = 64*w + __builtin_ctzll(bits);
+                if (best == -1 || empty_peers[i] > empty_peers[best]) {
+                    best = i;
+                }
+            }
+        }
+        *idx = best;
+        return true;
     }
 
-    for (int i = 0; i < 9; ++i) {
-        int val_col = board[i][c];
-        int val_row = board[r][i];
-        // val_qdr loops through all 9 values of the 3x3 grid containing (r, c)
-        int val_qdr = board[3*(r/3) + i%3][3*(c/3) + i/3];
+    return false;
+}
+
 
-        if (val_col != 0 && poss[r][c][val_col] != 0) {
-            poss[r][c][val_col] = 0;
-            --poss[r][c][0];
+int Sudoku::find_fewest_places(int *unit, int *val) const {
+    int fewest = 10;
+
+    for (int u = 0; u < variant->unit_count && fewest > 0; ++u) {
+        if (variant->unit_size[u] != 9) { // digits may be missing from smaller units
+            continue;
+        }
+
+        for (int v = 1; v <= 9; ++v) {
+            if (held[u][v] == 0 && places[u][v] < fewest) {
+                fewest = places[u][v];
+                *unit = u;
+                *val = v;
+            }
         }
+    }
+
+    return fewest;
+}
+
 
-        if (val_row != 0 && poss[r][c][val_row] != 0) {
-            poss[r][c][val_row] = 0;
-            --poss[r][c][0];
+void Sudoku::fill_poss(int idx) {
+    const int *cells = board[0];
+    int *p = poss[idx / 9][idx % 9];
+
+    int before = 0; // the possibilities counted as places, if it was empty
+    int after = 0x3fe; // bit v is set if v is possible
+    int n = 9;
+    for (int i = 1; i <= 9; ++i) {
+        before |= (p[i] != 0) << i;
+        p[i] = i;
+    }
+    if (p[0] == -1) {
+        before = 0;
+    }
+
+    const unsigned char *peers = variant->peers[idx];
+    int count = variant->peer_count[idx];
+    for (int i = 0; i < count; ++i) {
+        int val = cells[peers[i]];
+        if (val != 0 && p[val] != 0) {
+            p[val] = 0;
+            after &= ~(1 << val);
+            --n;
         }
+    }
 
-        if (val_qdr != 0 && poss[r][c][val_qdr] != 0) {
-            poss[r][c][val_qdr] = 0;
-            --poss[r][c][0];
+    int u = variant->sum_unit[idx];
+    if (u != -1 && cells[idx] == 0) {
+        for (int v = 1; v <= 9; ++v) {
+            if (p[v] != 0 && !(cage_allowed[u] & (1 << v))) {
+                p[v] = 0;
+                --n;
+            }
         }
+        after &= cage_allowed[u];
     }
 
-    if (board[r][c] != 0) {
-        poss[r][c][board[r][c]] = board[r][c];
-        poss[r][c][0] = -1;
+    if (cells[idx] != 0) {
+        p[cells[idx]] = cells[idx];
+        n = -1;
+        after = 0;
     }
 
+    set_count(idx, n);
+    move_places(idx, before, after);
 }
 
 
 void Sudoku::copy(Sudoku cpy) {
-    for (int i = 0; i < 9; ++i) {
-        for (int j = 0; j < 9; ++j) {
-            if (cpy.board[j][i] != 0) {
-                insert(j, i, cpy.board[j][i]);
+    const int *cells = cpy.board[0];
+
+    for (int i = 0; i < 81; ++i) {
+        if (cells[i] != 0) {
+            insert(i / 9, i % 9, cells[i]);
+        }
+    }
+}
+
+
+namespace {
+
+// fill(sud) fills the empty board of sud with a random grid, by searching:
+//    transforming seed grids (see grids.h) is faster, but gives less variety
+void fill(Sudoku *sud) {
+    sud->solve(); // arbitrarilly solve sud
+}
+
+
+// fill_and_carve(sud, max_blanks) is generate() without the latency recording
+int fill_and_carve(Sudoku *sud, int max_blanks) {
+    fill(sud);
+    return carve(sud, max_blanks);
+}
+
+
+// fill_and_carve_exact(sud, blanks) is generate_exact() without the latency
+//    recording, returning blanks on success and -1 on failure
+int fill_and_carve_exact(Sudoku *sud, int blanks) {
+    fill(sud);
+    return carve_exact(sud, blanks) ? blanks : -1;
+}
+
+
+// timed_generate(sud, blanks, make) returns make(sud, blanks), recording its
+//    latency and the puzzle made if it is the outermost call (see set_recorder())
+int timed_generate(Sudoku *sud, int blanks, int (*make)(Sudoku *, int)) {
+    if (!recorder || timed_depth > 0) {
+        return make(sud, blanks);
+    }
+
+    ++timed_depth;
+    Clock::time_point start = Clock::now();
+    int result = make(sud, blanks);
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    --timed_depth;
+
+    char puzzle[81];
+    board_cells(*sud, puzzle);
+    recorder->generate_times.record(ns);
+    recorder->slow_generates.offer(ns, puzzle);
+    return result;
+}
+
+
+// find_sets(sud, solution) stores the solution of sud in solution and returns its
+//    unavoidable sets (to be deleted), or NULL for variants: the sets rely on the
+//    classic units, so variants always solve
+UnavoidableSets *find_sets(const Sudoku &sud, int *solution) {
+    if (sud.variant != &CLASSIC) {
+        return NULL;
+    }
+
+    Sudoku solved;
+    solved.copy(sud);
+    solved.solve();
+    const int *cells = solved.board[0];
+    for (int i = 0; i < 81; ++i) {
+        solution[i] = cells[i];
+    }
+
+    UnavoidableSets *sets = new UnavoidableSets;
+    sets->find(solution, sud.board[0]);
+    return sets;
+}
+
+
+// try_remove(sud, idx, sets, table, solution) removes the clue at idx and returns
+//    true if sud still has exactly one solution, counting them with table (see
+//    Sudoku::set_table()). Otherwise the clue is put back, and if sets is not NULL,
+//    the cells where the second solution found differs from solution are added
+//    to sets.
+bool try_remove(Sudoku *sud, int idx, UnavoidableSets *sets, TranspositionTable *table,
+                const int *solution) {
+    if (sets && sets->blocks(idx)) { // rejected without solving
+        return false;
+    }
+
+    int y = idx / 9;
+    int x = idx % 9;
+    int removed = sud->remove(y, x);
+
+    Sudoku tester(sud->variant);
+    tester.set_heuristics(FEWEST_PLACES, RANDOM_START); // only counting
+    tester.set_table(table);
+    tester.copy(*sud);
+
+    int solutions = tester.solve();
+    if (solutions == 1) {
+        if (sets) {
+            sets->removed(idx);
+        }
+        return true;
+    }
+
+    if (sets && solutions == 2) {
+        // tester.board holds the second solution found. The cells where
+        //    it differs from the real one (y, x among them) form a set
+        const int *second = tester.board[0];
+        int diff[81];
+        int size = 0;
+        for (int i = 0; i < 81; ++i) {
+            if (second[i] != solution[i]) {
+                diff[size++] = i;
+            }
+        }
+        sud->board[y][x] = removed; // count y, x as a clue again
+        if (size > 0) {
+            sets->add(diff, size, sud->board[0]);
+        }
+        sud->board[y][x] = 0;
+    }
+    // removing the current item made the puzzle invalid, so we add it back
+    sud->insert(y, x, removed);
+    return false;
+}
+
+
+// removable_bound(sud, skip, sets) returns a bound on the number of clues of sud
+//    that can be removed, keeping one solution, when the positions in skip (see
+//    carve_from()) can't be. The last clues of sets are added to skip.
+int removable_bound(const Sudoku &sud, uint64_t *skip, const UnavoidableSets *sets) {
+    const int *cells = sud.board[0];
+
+    int left = 0;
+    for (int i = 0; i < 81; ++i) {
+        uint64_t bit = 1ULL << (i % 64);
+        if (cells[i] == 0 || (skip[i / 64] & bit)) {
+            continue;
+        }
+        if (sets && sets->blocks(i)) { // stays in every puzzle made from sud
+            skip[i / 64] |= bit;
+            continue;
+        }
+        ++left;
+    }
+
+    return sets ? left - sets->packing(cells, skip) : left;
+}
+
+
+// carve_from(sud, order, need, skip, tries, sets, table, solution) is carve_exact() for
+//    need more clues, trying clues in the order given by order (all 81 positions),
+//    and never the positions in skip (bit i % 64 of skip[i / 64] for position i).
+//    Gives up (returning false with *tries below 0) after *tries removals tried.
+bool carve_from(Sudoku *sud, const int *order, int need, const uint64_t *skip, long *tries,
+                UnavoidableSets *sets, TranspositionTable *table, const int *solution) {
+    if (need == 0) {
+        return true;
+    }
+
+    const int *cells = sud->board[0];
+    uint64_t tried[2] = {skip[0], skip[1]};
+
+    for (int k = 0; k < 81; ++k) {
+        int idx = order[k];
+        uint64_t bit = 1ULL << (idx % 64);
+        if (cells[idx] == 0 || (tried[idx / 64] & bit)) {
+            continue;
+        }
+
+        if (removable_bound(*sud, tried, sets) < need) {
+            return false;
+        }
+        if (tried[idx / 64] & bit) { // found blocked
+            continue;
+        }
+
+        // from now on idx is skipped: if it can't be removed here, it can't from any
+        //    puzzle made by removing more, and if it can, every set of removals
+        //    containing it is tried below
+        tried[idx / 64] |= bit;
+
+        if (--*tries < 0) {
+            return false;
+        }
+
+        int val = cells[idx];
+        if (try_remove(sud, idx, sets, table, solution)) {
+            if (carve_from(sud, order, need - 1, tried, tries, sets, table, solution)) {
+                return true;
+            }
+            sud->insert(idx / 9, idx % 9, val);
+            if (sets) {
+                sets->restored(idx);
             }
         }
     }
+
+    return false;
 }
 
+} // namespace
+
 
 int generate(Sudoku *sud, int max_blanks) {
-    sud->solve(); // arbitrarilly solve sud
+    return timed_generate(sud, max_blanks, fill_and_carve);
+}
+
+
+bool generate_exact(Sudoku *sud, int blanks) {
+    return timed_generate(sud, blanks, fill_and_carve_exact) == blanks;
+}
+
+
+int solve_portfolio(Sudoku *sud, int searches, int restart_unit) {
+    if (searches == 0) {
+        searches = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    ++timed_depth; // recorded once, below
+    Clock::time_point start = Clock::now();
+    char input[81];
+    board_cells(*sud, input);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> winner(-1);
+    std::vector<Sudoku> copies(searches, *sud);
+    std::vector<int> results(searches);
+    std::vector<std::thread> threads;
+
+    uint32_t seed = thread_random(1 << 30);
+    for (int i = 0; i < searches; ++i) {
+        copies[i].set_seed((seed + 0x9e3779b9u * i) | 1); // never 0
+        copies[i].set_restarts(restart_unit);
+        copies[i].set_stop(&done);
+    }
+
+    for (int i = 0; i < searches; ++i) {
+        threads.emplace_back([&, i] {
+            results[i] = copies[i].count_solutions();
+            int none = -1;
+            if (results[i] != -1 && winner.compare_exchange_strong(none, i)) {
+                done = true; // cancel the others
+            }
+        });
+    }
+    for (int i = 0; i < searches; ++i) {
+        threads[i].join();
+    }
+
+    int w = winner.load();
+    sud->clear();
+    sud->copy(copies[w]);
+
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    --timed_depth;
+    if (recorder && timed_depth == 0) {
+        recorder->solve_times.record(ns);
+        recorder->slow_solves.offer(ns, input);
+    }
+    return results[w];
+}
+
+
+void set_recorder(LatencyRecorder *rec) {
+    recorder = rec;
+}
+
+
+namespace {
+
+// carve_clues(sud, max_blanks) is carve() without the latency recording
+int carve_clues(Sudoku *sud, int max_blanks) {
+    // removals that would empty an unavoidable set are rejected without solving
+    int solution[81];
+    UnavoidableSets *sets = find_sets(*sud, solution);
+
+    // the puzzles tried differ by a few clues, so their searches meet the same boards
+    TranspositionTable table(CARVE_TABLE);
 
     int blanks = 0;
     while (blanks < max_blanks) {
-        int start_y = rand() % 9; // find a random position
-        int start_x = rand() % 9;
+        int start_y = thread_random(9); // find a random position
+        int start_x = thread_random(9);
 
         int y = start_y;
         int x = start_x;
 
         bool tried_first = false;
         do { // loops until we find an item we can remove
-            if (sud->board[y][x] != 0) {
-                int removed = sud->remove(y, x);
-
-                Sudoku tester;
-                tester.copy(*sud);
-
-                if (tester.solve() == 1) {
-                    break; // removing this item worked, we can exit the loop
-                }
-                // removing the current item made the puzzle invalid, so we add it back
-                sud->insert(y, x, removed);
+            if (sud->board[y][x] != 0 && try_remove(sud, 9*y + x, sets, &table, solution)) {
+                break; // removing this item worked, we can exit the loop
             }
 
             tried_first = true; // we tried the first position, no succes
@@ -325,6 +1672,84 @@ int generate(Sudoku *sud, int max_blanks) {
         }
     } // loop until we have removed max_blanks items (or no more possibilities)
 
+    delete sets;
     return blanks;
 }
 
+
+// carve_clues_exact(sud, blanks) is carve_exact() without the latency recording,
+//    returning blanks on success and -1 on failure
+int carve_clues_exact(Sudoku *sud, int blanks) {
+    if (blanks > MAX_BLANKS) {
+        return -1;
+    }
+
+    int solution[81];
+    UnavoidableSets *sets = find_sets(*sud, solution);
+    TranspositionTable table(CARVE_TABLE); // see carve()
+
+    int order[81];
+    for (int i = 0; i < 81; ++i) {
+        order[i] = i;
+    }
+
+    // searches that go on too long start over with another order (keeping the
+    //    grid, and the sets learned), with twice the limit each time, until
+    //    CARVE_TRIES removals were tried in all
+    bool carved = false;
+    long tries = -1;
+    long left = CARVE_TRIES;
+    for (long limit = 4*81; tries < 0 && left > 0; limit *= 2) {
+        for (int i = 80; i > 0; --i) { // a random order of the positions
+            std::swap(order[i], order[thread_random(i + 1)]);
+        }
+
+        uint64_t skip[2] = {0, 0};
+        tries = std::min(limit, left);
+        left -= tries;
+        carved = carve_from(sud, order, blanks, skip, &tries, sets, &table, solution);
+    }
+
+    delete sets;
+    return carved ? blanks : -1;
+}
+
+} // namespace
+
+
+int carve(Sudoku *sud, int max_blanks) {
+    return timed_generate(sud, max_blanks, carve_clues);
+}
+
+
+bool carve_exact(Sudoku *sud, int blanks) {
+    return timed_generate(sud, blanks, carve_clues_exact) == blanks;
+}
+
+
+
+int blanks_for(int diff) {
+    return 41 + thread_random(5) + (5*diff);
+}
+
+
+bool read_board(Sudoku *sud, const char *str) {
+    for (int i = 0; i < 81; ++i) {
+        char ch = str[i];
+        if ('1' <= ch && ch <= '9') {
+            sud->insert(i / 9, i % 9, ch - '0');
+        } else if (ch != '0' && ch != '.') { // also catches a null terminator
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void write_board(const Sudoku &sud, char *str) {
+    for (int i = 0; i < 81; ++i) {
+        str[i] = '0' + sud.board[i / 9][i % 9];
+    }
+    str[81] = '\0';
+}
@@ -1,9 +1,159 @@
 #ifndef SUDOKU_H
 #define SUDOKU_H
 
+#include <atomic>
+#include <cstdint>
+
 // NOTE: the seed for rand() must be set before using this module.
 //       use the command 'srand(time(NULL))'
 //       include <cstdlib> for rand() and srand() , <ctime> for time().
+//       Each thread draws its random numbers from its own generator, seeded
+//       with rand() the first time it needs one, so threads don't contend on rand().
+
+// Variant holds the constraints of a 9x9 puzzle as data, with cells numbered 0-80
+//    in row-major order. A unit is a group of at most 9 cells that must hold
+//    different digits, and may also need to add up to a given sum (a killer cage).
+//    Classic sudoku has 27 units: rows 0-8, columns 9-17, 3x3 grids 18-26.
+// The peer table (the cells sharing a unit with each cell, sorted by index) is
+//    what the solver walks, so every variant runs on the same search code.
+class Variant {
+public:
+    static const int MAXUNITS = 27 + 2 + 81; // classic, diagonals, one cage per cell
+    static const int MAXFULL = 6; // 9-cell units per cell: row, column, grid, diagonals, cage
+
+    // constructor for Variant class - classic sudoku, no input required
+    constexpr Variant(): unit_count(27), units(), unit_size(), unit_sum(),
+                         sum_unit(), full_count(), full_units(), peer_count(), peers() {
+        for (int i = 0; i < 81; ++i) {
+            int r = i / 9;
+            int c = i % 9;
+            units[r][c] = i;
+            units[9 + c][r] = i;
+            units[18 + 3*(r/3) + c/3][3*(r%3) + c%3] = i;
+        }
+        for (int u = 0; u < 27; ++u) {
+            unit_size[u] = 9;
+        }
+        update();
+    }
+
+    // add_unit(cells, size) adds a unit without a sum: the size cells listed in
+    //    cells must hold different digits. Returns false (and does nothing) if
+    //    there is no room for it (see MAXUNITS and MAXFULL).
+    // requires: 1 <= size <= 9
+    //           0 <= cells[i] <= 80, all different
+    bool add_unit(const int *cells, int size);
+
+    // add_diagonals() adds the two main diagonals as units (X-Sudoku).
+    //    Returns false (and does nothing) if there is no room for them, as when
+    //    they were added already.
+    bool add_diagonals();
+
+    // set_regions(regions) replaces the 3x3 grids with 9 irregular regions
+    //    (jigsaw sudoku): cell i belongs to region regions[i]. Returns false
+    //    (and does nothing) if the regions don't have 9 cells each.
+    // requires: 0 <= regions[i] <= 8 for 0 <= i <= 80
+    bool set_regions(const int *regions);
+
+    // add_cage(cells, size, sum) adds a killer cage: the size cells listed in cells
+    //    must hold different digits adding up to sum. Returns false (and does
+    //    nothing) if one of the cells is already in a cage or there is no room.
+    // requires: 1 <= size <= 9
+    //           0 <= cells[i] <= 80, all different
+    bool add_cage(const int *cells, int size, int sum);
+
+    int unit_count;
+    unsigned char units[MAXUNITS][9];
+    int unit_size[MAXUNITS];
+    int unit_sum[MAXUNITS]; // 0 if the unit has no sum
+
+    // index of the unit with a sum (cage) containing each cell, -1 if none
+    int sum_unit[81];
+
+    // the 9-cell units containing each cell
+    int full_count[81];
+    unsigned char full_units[81][MAXFULL];
+
+    int peer_count[81];
+    unsigned char peers[81][80];
+
+private:
+    // update() rebuilds sum_unit, full_count, full_units, peer_count and peers
+    //    from the units
+    constexpr void update() {
+        bool shared[81][81] = {}; // shared[i][j] is true if i and j are in a unit
+
+        for (int u = 0; u < unit_count; ++u) {
+            for (int k = 0; k < unit_size[u]; ++k) {
+                for (int l = 0; l < unit_size[u]; ++l) {
+                    shared[units[u][k]][units[u][l]] = true;
+                }
+            }
+        }
+
+        for (int i = 0; i < 81; ++i) {
+            sum_unit[i] = -1;
+            full_count[i] = 0;
+            int n = 0;
+            for (int j = 0; j < 81; ++j) { // ascending, so peers are sorted
+                if (j != i && shared[i][j]) {
+                    peers[i][n++] = j;
+                }
+            }
+            peer_count[i] = n;
+        }
+
+        for (int u = 0; u < unit_count; ++u) {
+            if (unit_sum[u] != 0) {
+                for (int k = 0; k < unit_size[u]; ++k) {
+                    sum_unit[units[u][k]] = u;
+                }
+            }
+            if (unit_size[u] == 9) {
+                for (int k = 0; k < 9; ++k) {
+                    int i = units[u][k];
+                    full_units[i][full_count[i]++] = u;
+                }
+            }
+        }
+    }
+};
+
+// the constraints of classic sudoku, used unless another Variant is given
+extern const Variant CLASSIC;
+
+// combinations of placements learned to lead nowhere (see set_learning())
+struct Nogoods;
+
+class TranspositionTable;
+
+
+// Branching selects the empty position solve() fills next (see set_heuristics())
+enum Branching {
+    // the position with the fewest possibilities, ties broken at random (default)
+    RANDOM_MRV,
+
+    // the position with the fewest possibilities, ties broken by the number
+    //    of empty positions sharing a unit with it (then by the lowest index)
+    MRV_DEGREE,
+
+    // like MRV_DEGREE, except that when some digit has fewer possible positions
+    //    left in a 9-cell unit than that position has possibilities, the branches
+    //    are the positions of that digit instead
+    FEWEST_PLACES
+};
+
+
+// ValueOrder selects the order in which solve() tries the possibilities of a position
+enum ValueOrder {
+    // increasing, starting from a random digit (default)
+    RANDOM_START,
+
+    // least constraining value first: the digit that is a possibility of the fewest
+    //    empty positions sharing a unit with it (then the lowest digit)
+    LEAST_CONSTRAINING
+};
+
 
 class Sudoku {
 public:
@@ -11,6 +161,13 @@ public:
     // sol_count is set to -1, board is 0-filled, poss is properly filled
     Sudoku();
 
+    // constructor for sudoku class with the constraints of var instead of CLASSIC
+    // requires: var outlives this
+    explicit Sudoku(const Variant *var);
+
+    // the constraints of the puzzle (do not change once the Sudoku is created)
+    const Variant *variant;
+
     // stores the value at each position of the board, 0 means blank
     int board[9][9];    
 
@@ -31,17 +188,81 @@ public:
 
     // solve() solves the puzzle if possible, and returns 0 if there are
     //    no solutions, 1 if there is only one, and 2 if there are multiple.
+    //    Returns -1 if it was stopped (see set_stop()).
     int solve();
 
     // valid() returns true if the entries in this->board are
-    //    valid (no duplicates in rows, columns or squares)
+    //    valid (no duplicates in a unit, and no cage whose sum can't be reached)
     bool valid() const;
 
+    // candidates(row, col) returns the possibilities of the position at row, col
+    //    as a mask (bit v is set if v can be placed there), 0 if it is filled
+    // requires: 0 <= row, col <= 8
+    int candidates(int row, int col) const;
+
+    // set_heuristics(branching, order) changes how solve() searches. Only the
+    //    defaults (RANDOM_MRV, RANDOM_START) make random choices, so they are the ones to use
+    //    for generating; the others often visit far fewer positions on hard puzzles.
+    void set_heuristics(Branching branching, ValueOrder order);
+
+    // set_stop(flag) makes solve() give up as soon as *flag is true (it is checked
+    //    before each position is filled), leaving board partly filled. Lets another
+    //    thread cancel a search whose answer is no longer needed. NULL (the
+    //    default) never gives up.
+    void set_stop(const std::atomic<bool> *flag);
+
+    // set_learning(on) switches solve() to conflict-directed backjumping with
+    //    nogood learning: when every digit of a position fails, the guesses that
+    //    caused it are found, the search jumps straight back to the latest of them,
+    //    and the combination is remembered so that later branches containing it
+    //    are cut at once. Positions are chosen like MRV_DEGREE (the branching set
+    //    by set_heuristics() is ignored), the value order is kept. Slower on
+    //    ordinary puzzles, but bounds the worst cases of chronological backtracking.
+    void set_learning(bool on);
+
+    // set_table(table) makes solve() look up each board it reaches in table (see
+    //    table.h) before searching it, and record the boards it finishes searching
+    //    without finding a second solution. A board that is a dead end, or whose
+    //    only solution is already known while none has been found yet, is then not
+    //    searched again. Since each branch splits the possibilities, a search
+    //    never reaches the same board twice: the savings come from the pass that
+    //    fills in a unique solution, from restarts, and from other searches
+    //    sharing table (as carve() does for puzzles a few clues apart). The
+    //    results are unchanged, and board still ends up holding the solution(s)
+    //    found. Not used with
+    //    set_learning(). NULL (the default) turns this off.
+    // requires: table is only shared by Sudokus with the same variant
+    //           table outlives its use
+    void set_table(TranspositionTable *table);
+
+    // set_seed(seed) gives this its own random number generator, seeded with seed,
+    //    for the random choices of solve() (RANDOM_MRV, RANDOM_START), so that
+    //    its searches can be repeated. 0 (the default) goes back to the generator
+    //    of the calling thread (see the note at the top).
+    void set_seed(uint32_t seed);
+
+    // set_restarts(unit) makes solve() start its search over, with new random
+    //    choices, after filling unit, unit, 2 unit, unit, unit, 2 unit, 4 unit, ...
+    //    positions (the Luby sequence), so that a run of bad early guesses can't
+    //    keep it stuck. Restarts stop once a solution is found: checking for
+    //    others needs a complete search anyway. The result is the same, only the
+    //    time changes. 0 (the default) never restarts.
+    // requires: unit >= 0
+    void set_restarts(int unit);
+
+    // positions() returns the number of positions filled by the last solve() (by
+    //    its last restart, see set_restarts()) while counting the solutions, a
+    //    measure of how hard the board was for the search. Filling in a unique
+    //    solution afterwards is not included.
+    long positions() const;
+
     // copy(cpy) gives this->board the same values as
-    //    cpy.board, and properly fills this->poss
+    //    cpy.board, and properly fills this->poss (the variant is not copied)
     void copy(Sudoku cpy);
 
 private:
+    friend class Solutions;
+
     // each length-10 array corresponds to one board position
     // the first element of each array holds the total number of
     //    possibilities, or -1 if the board position has been filled
@@ -54,6 +275,68 @@ private:
     // during the latter, sol_count stores the number of solutions found
     int sol_count;
 
+    Branching branching;
+    ValueOrder value_order;
+    const std::atomic<bool> *stop;
+    bool learning;
+    uint32_t rng; // 0 to use the generator of the thread
+    int restart_unit;
+
+    TranspositionTable *table;
+
+    // Zobrist hash of board: the xor of a random key for each (position, digit)
+    //    on it, kept up to date by insert() and remove()
+    uint64_t zobrist;
+
+    // positions filled by the current search, and the number after which it
+    //    gives up (0 for no limit)
+    long nodes;
+    long limit;
+
+    // random(n) returns a random number from 0 to n - 1 (see set_seed())
+    // requires: n >= 1
+    int random(int n);
+
+    // halted() counts one more position filled, and returns true if the search
+    //    must give up (stopped, or over its limit)
+    bool halted();
+
+    // the empty positions grouped by number of possibilities: bit i % 64 of
+    //    by_poss[n][i / 64] is set if position i is empty and has n possibilities.
+    //    Kept up to date by every change to poss, so the position with the
+    //    fewest possibilities is found without scanning the board
+    uint64_t by_poss[10][2];
+
+    // number of empty positions sharing a unit with each position
+    int empty_peers[81];
+
+    // for each cage, cage_digits() of it, kept up to date by insert() and remove()
+    //    and folded into poss, so every heuristic sees the cage sums
+    int cage_allowed[Variant::MAXUNITS];
+
+    // for each 9-cell unit and digit, the number of empty positions of the unit
+    //    where the digit is possible, and the number of positions holding it.
+    //    Kept up to date by every change to poss, for find_fewest_places().
+    unsigned char places[Variant::MAXUNITS][10];
+    unsigned char held[Variant::MAXUNITS][10];
+
+    // drop_place(idx, val) takes val out of the possibilities of the empty
+    //    position at idx, updating its count and places
+    // requires: poss[idx / 9][idx % 9][val] != 0
+    void drop_place(int idx, int val);
+
+    // move_places(idx, before, after) updates places for the position at idx,
+    //    whose counted possibilities change from the digits in the mask before
+    //    to the ones in after (bit v set for v)
+    void move_places(int idx, int before, int after);
+
+    // set_count(idx, n) changes the number of possibilities of the position
+    //    at idx (row idx / 9, column idx % 9) from its poss[..][..][0] to n
+    //    (-1 once filled), moving it between the by_poss groups
+    // requires: 0 <= idx <= 80
+    //           -1 <= n <= 9
+    void set_count(int idx, int n);
+
     // find_sol() uses mutual recursion with find_sol_pos() to solve this. Returns
     //    true if solved, false if unsolvable.
     // requires: puzzle must be valid
@@ -67,24 +350,195 @@ private:
     // find_least_poss(row, col) find the empty spot in grd with the least
     //    possibilities, and stores its position in row, col. returns false if no
     //    empty spots are found, true otherwise.
-    bool find_least_poss(int *row, int *col) const;
+    bool find_least_poss(int *row, int *col);
+
+    // find_best_cell(idx) stores the empty position with the fewest possibilities
+    //    in idx (ties broken by empty_peers if degree is true, otherwise the lowest
+    //    index wins). Returns false if there are no empty positions.
+    bool find_best_cell(int *idx, bool degree) const;
+
+    // find_fewest_places(unit, val) finds the digit that can go in the fewest
+    //    positions of a 9-cell unit, among the digits that unit still lacks, and
+    //    stores them in val and unit. Returns that number of positions, or 10 if
+    //    every 9-cell unit is full.
+    int find_fewest_places(int *unit, int *val) const;
+
+    // search() runs find_sol(), or learn_sol() if learning is true
+    bool search();
 
-    // fill_poss(r, c) re-evluates the possibilities of
-    //    the position at row r, column c in grd
-    // requires: 0 <= r, c <= 8
-    void fill_poss(int r, int c);
+    // learn_sol(learned, depth, conflict) is find_sol() with backjumping: it fills
+    //    the position with the fewest possibilities (a guess at depth depth) and
+    //    recurses. When no solution is found, the positions whose digits caused
+    //    the failure are stored in conflict (bit i % 64 of conflict[i / 64] for
+    //    position i), and recorded in learned if no solution was found below.
+    // requires: depth >= 1
+    bool learn_sol(Nogoods *learned, int depth, uint64_t *conflict);
+
+    // find_sol_unit(u, val) uses mutual recursion with find_sol(), trying val
+    //    in each position of unit u where it is possible
+    bool find_sol_unit(int u, int val);
+
+    // least_constraining(idx, vals) stores the possibilities of the position
+    //    at idx in vals in LEAST_CONSTRAINING order, and returns how many there are
+    int least_constraining(int idx, int *vals) const;
+
+    // fill_poss(idx) re-evluates the possibilities of
+    //    the position at row idx / 9, column idx % 9 in grd
+    // requires: 0 <= idx <= 80
+    void fill_poss(int idx);
+
+    // cage_digits(u) returns the digits (bit v set for v) that an empty position
+    //    of the cage u can hold with the cage still able to reach its sum
+    // requires: variant->unit_sum[u] != 0
+    int cage_digits(int u) const;
+
+    // update_cage(u) recomputes cage_allowed[u] and takes the digits it no
+    //    longer allows out of the possibilities of the empty positions of cage u
+    // requires: variant->unit_sum[u] != 0
+    void update_cage(int u);
+
+    // count_solutions() is solve() without the latency recording
+    int count_solutions();
+
+    // count_once() is count_solutions() without restarts. Returns -1 if the
+    //    search was stopped or went over its limit.
+    int count_once();
+
+    friend int solve_portfolio(Sudoku *sud, int searches, int restart_unit);
 
     //sudoku_filled() returns true if all spots in this->board have been filled (with non-0's)
     bool sudoku_filled() const;
 };
 
 
+// Solutions enumerates every completion of a board lazily, like a generator:
+//    each call to next() resumes the search where the previous one stopped and
+//    pauses at the next solution. The search state is an explicit stack of at
+//    most 81 (cell, digit) pairs, so memory use is constant however many
+//    solutions there are, and the enumeration can be abandoned at any point.
+// Solutions come in a fixed order (cells with the fewest possibilities first,
+//    digits in increasing order), without using rand().
+//
+// Example:
+//    Solutions all(puzzle);
+//    while (all.next()) {
+//        use(all.current().board);
+//    }
+class Solutions {
+public:
+    // constructor for Solutions class - enumerates the completions of start
+    //    (start itself is not modified)
+    explicit Solutions(const Sudoku &start);
+
+    // next() moves to the next solution and returns true, or returns false once
+    //    every solution has been returned (and on every later call)
+    bool next();
+
+    // current() returns the board holding the latest solution
+    // requires: the last call to next() returned true
+    const Sudoku &current() const;
+
+private:
+    Sudoku sud;
+    bool started;
+    bool done;
+
+    // the guesses in progress: cell[i] holds digit[i] (0 before the first try)
+    int depth;
+    int cell[81];
+    int digit[81];
+
+    // step() replaces the digit of the latest guess with the next possible one and
+    //    returns true, or undoes the guess and returns false if there is none left
+    bool step();
+
+    // backtrack() moves to the next untried branch and returns true, or returns
+    //    false if the whole tree has been searched
+    bool backtrack();
+};
+
+
 // generate(sud, max_blanks) returns a valid sudoku (has only 1 solution)
 //    with at most max_blanks empty spots
 // requires: sud->board is empty (0-filled)
 //           max_blanks >= 0
 int generate(Sudoku *sud, int max_blanks);
 
+// generate_exact(sud, blanks) is generate() with exactly blanks empty spots (see
+//    carve_exact()). Returns false, leaving sud filled, if carving the grid it
+//    picked as solution failed.
+// requires: sud->board is empty (0-filled)
+//           0 <= blanks <= 81
+bool generate_exact(Sudoku *sud, int blanks);
+
+
+// solve_portfolio(sud, searches, restart_unit) solves sud like sud->solve(), by
+//    racing searches copies of it on separate threads, each with its own random
+//    seed (and restarts every restart_unit positions, see set_restarts()). The
+//    first copy to finish wins and the others are cancelled. Since solve() times
+//    vary a lot with the random choices, this cuts the slowest solves down on a
+//    machine with idle cores. 0 searches runs one per core. If sud has a table
+//    (see set_table()), the copies share it.
+// requires: searches >= 0
+//           restart_unit >= 0
+int solve_portfolio(Sudoku *sud, int searches, int restart_unit);
+
+
+class LatencyRecorder;
+
+// set_recorder(rec) makes the outermost solve() and generate() call on each thread
+//    record its wall time in rec, with the input board (for solve) or the puzzle
+//    made (for generate) kept if it is among the slowest (see latency.h). A
+//    carve() or carve_exact() call counts as a generate, and the solves it does
+//    to check uniqueness are not recorded.
+//    NULL (the default) turns recording off.
+// requires: no solve(), generate() or carve() call is in progress
+//           rec outlives the calls it records
+void set_recorder(LatencyRecorder *rec);
+
+// carve(sud, max_blanks) removes at most max_blanks clues from sud at random, one
+//    at a time, keeping only removals after which sud still has exactly one
+//    solution. Returns the number of clues removed. generate() is solve() + carve()
+//    For classic puzzles, removals that would leave an unavoidable set of the
+//    solution without clues are rejected at once, without solving. The sets come
+//    from digit-pair swaps, and from the second solution of each failed removal
+// requires: sud has exactly one solution (e.g. it is completely filled)
+//           max_blanks >= 0
+int carve(Sudoku *sud, int max_blanks);
+
+// carve_exact(sud, blanks) removes exactly blanks clues from sud, keeping exactly
+//    one solution, and returns true. The removals are tried in a random order,
+//    like carve(), but when no clue is left to remove before reaching blanks,
+//    the last removals are undone and others tried instead (depth first, each
+//    set of removals tried once). A clue that can't be removed from a puzzle
+//    can't be removed from any puzzle made from it by removing more, so such
+//    clues are never tried again in that branch. Returns false, leaving sud
+//    unchanged, once every set of removals has failed, or after about 16000
+//    removals tried in all (a few seconds), or at once if blanks > 64 (a puzzle
+//    with one solution has at least 17 clues). In practice up to about 58
+//    blanks succeed; from 60 on, most grids hit the limit.
+// requires: sud has exactly one solution (e.g. it is completely filled)
+//           blanks >= 0
+bool carve_exact(Sudoku *sud, int blanks);
+
+
+// blanks_for(diff) returns a random number of blanks for a puzzle of difficulty diff:
+//    41-45 for easy (0), 46-50 for medium (1) and 51-55 for difficult (2)
+// requires: 0 <= diff <= 2
+int blanks_for(int diff);
+
+
+// read_board(sud, str) inserts the 81 characters of str into sud in row-major order
+//    ('1'-'9' are clues, '0' or '.' are blanks). Returns false if str has another
+//    character or fewer than 81 characters (sud may then be partially filled)
+// requires: sud->board is empty (0-filled)
+bool read_board(Sudoku *sud, const char *str);
+
+// write_board(sud, str) writes sud.board into str as 81 characters in row-major
+//    order ('0' for blanks), followed by a null terminator
+// requires: str has room for 82 characters
+void write_board(const Sudoku &sud, char *str);
+
 #endif // SUDOKU_H
 
 
@@ -10,17 +10,53 @@ const int PENPOINT = 16; // font for penmarks
 const int PENCILPOINT = 7; // font for pencilmarks
 const QString DEFPENCIL = "        \n        \n       "; // default pencilmark text (placeholder)
 
+const QString LOCKEDSTYLE = "QPushButton {color: grey;}"; // givens
+const QString UNLOCKEDSTYLE = "QPushButton {color: black;}"; // penmarks
+const QString CONFLICTSTYLE = "QPushButton {color: red;}"; // duplicate in a row, column or grid
+const QString MISTAKESTYLE = "QPushButton {color: #e07000;}"; // differs from the solution
+
+
+// pencil_text(mask) returns the text displaying the pencilmarks in mask (see the
+//    pencil member). The 512 possible texts are built on first use, so displaying
+//    pencilmarks never allocates a string.
+static const QString &pencil_text(int mask) {
+    static QString texts[512];
+    static bool built = false;
+
+    if (!built) {
+        for (int m = 0; m < 512; ++m) {
+            texts[m] = DEFPENCIL;
+            for (int num = 1; num <= 9; ++num) {
+                if (m & (1 << (num - 1))) {
+                    texts[m][(num - 1)*3] = QChar('0' + num);
+                }
+            }
+        }
+        built = true;
+    }
+
+    return texts[mask >> 1];
+}
+
 
 // SEE SUDOKY.H FOR DOCUMENTATION
 
 Sudoky::Sudoky(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::Sudoky),
+    auto_pencil(false),
     selx(-1),
     sely(-1),
     selected(NULL),
     state(-1),
-    main()
+    main(),
+    work(),
+    board_gen(0),
+    custom_count(-1),
+    check_quit(false),
+    check_request(0),
+    checked_gen(0),
+    check_stop(false)
 {
     ui->setupUi(this);
 
@@ -33,11 +69,21 @@ Sudoky::Sudoky(QWidget *parent) :
     srand(time(NULL)); // generates a seed for random number generation
 
     set_shortcuts();
+
+    checker = std::thread(&Sudoky::check_loop, this);
 }
 
 
 Sudoky::~Sudoky()
 {
+    {
+        std::lock_guard<std::mutex> guard(check_lock);
+        check_quit = true;
+        check_stop = true;
+    }
+    check_wake.notify_one();
+    checker.join();
+
     delete ui;
 }
 
@@ -48,8 +94,9 @@ void Sudoky::board_map() {
     int but = 1;
     for (int i = 0; i < 9; ++i) {
         for (int j = 0; j < 9; ++j) {
-            pencil[i][j] = DEFPENCIL;
+            pencil[i][j] = 0;
             unlocked[i][j] = false;
+            pen[i][j] = 0;
             buttons[i][j] = findChild<QPushButton *>("pushButton_" + QString::number(but));
             ++but;
             buttons[i][j]->setText(NULL);
@@ -142,30 +189,242 @@ void Sudoky::num_click(int num) {
     }
 
     if (ui->penRadio->isChecked()) {
-        if (selected->text() == QString::number(num) || num == 0) {
+        if (pen[sely][selx] == num || num == 0) {
+            set_pen(sely, selx, 0);
             selected->setText(NULL);
         } else {
+            set_pen(sely, selx, num);
             selected->setText(QString::number(num));
         }
         QFont f = selected->font();
         f.setPointSize(PENPOINT);
         selected->setFont(f);
+    } else if (num == 0) {
+        pencil[sely][selx] = 0;
     } else {
-        QString *penc = &pencil[sely][selx];
-        if (num == 0) {
-            *penc = DEFPENCIL;
-        } else if (penc->at((num - 1)*3).digitValue() == num) { // num is present in the pencilmark
-            penc->replace(((num - 1)*3), 1, ' '); // replace num with ' ' in the pencilmark
-        } else { // num is not in the pencilmark
-            penc->replace(((num - 1)*3), 1, num + '0'); // replace the corresponding ' ' with num in the pencilmark
+        pencil[sely][selx] ^= 1 << num; // toggle num in the pencilmark
+    }
+
+    show_pencil(sely, selx);
+}
+
+
+void Sudoky::show_pencil(int y, int x) {
+    if (pen[y][x] != 0) {
+        return;
+    }
+
+    buttons[y][x]->setText(pencil_text(pencil[y][x]));
+    QFont f = buttons[y][x]->font();
+    f.setPointSize(PENCILPOINT);
+    buttons[y][x]->setFont(f);
+}
+
+
+void Sudoky::set_pen(int y, int x, int num) {
+    int old = pen[y][x];
+    if (old == num) {
+        return;
+    }
+
+    pen[y][x] = num;
+
+    if (old != 0) {
+        work.remove(y, x);
+        count_digit(y, x, old, -1);
+    }
+    if (num != 0) {
+        work.insert(y, x, num);
+        count_digit(y, x, num, 1);
+    }
+
+    if (0 <= state && state <= 3 && unlocked[y][x]) { // main.board holds the solution
+        int sol = main.board[y][x];
+        unsolved += (num != sol) - (old != sol);
+    }
+
+    paint_cell(y, x);
+
+    if (auto_pencil && 0 <= state && state <= 3) {
+        update_candidates(y, x, old, num);
+    }
+
+    if (state == 4) {
+        custom_changed(y, x, old, num);
+    }
+}
+
+
+void Sudoky::custom_changed(int y, int x, int old, int num) {
+    ++board_gen;
+
+    if (old == 0 && custom_count == 0) { // more clues can't make it solvable
+        check_stop = true; // the check in progress (if any) is stale
+    } else if (old == 0 && custom_count == 1) {
+        custom_count = custom_solution[y][x] == num ? 1 : 0;
+        check_stop = true;
+    } else {
+        custom_count = -1;
+        {
+            std::lock_guard<std::mutex> guard(check_lock);
+            for (int i = 0; i < 81; ++i) {
+                check_cells[i] = pen[i / 9][i % 9];
+            }
+            check_request = board_gen;
+            check_stop = true;
+        }
+        check_wake.notify_one();
+    }
+
+    update_label();
+}
+
+
+void Sudoky::check_loop() {
+    int taken = 0; // board_gen of the last board checked
+
+    for (;;) {
+        Sudoku sud;
+        sud.set_heuristics(FEWEST_PLACES, LEAST_CONSTRAINING); // doesn't use rand()
+        sud.set_stop(&check_stop);
+
+        {
+            std::unique_lock<std::mutex> guard(check_lock);
+            check_wake.wait(guard, [&] { return check_quit || check_request != taken; });
+            if (check_quit) {
+                return;
+            }
+
+            taken = check_request;
+            for (int i = 0; i < 81; ++i) {
+                if (check_cells[i] != 0) {
+                    sud.insert(i / 9, i % 9, check_cells[i]);
+                }
+            }
+            check_stop = false;
+        }
+
+        int solutions = sud.solve();
+        if (solutions == -1) { // cancelled, the board has changed
+            continue;
         }
+
+        if (solutions == 1) {
+            std::lock_guard<std::mutex> guard(check_lock);
+            const int *cells = sud.board[0];
+            for (int i = 0; i < 81; ++i) {
+                checked_solution[i] = cells[i];
+            }
+            checked_gen = taken;
+        }
+
+        QMetaObject::invokeMethod(this, "check_done", Qt::QueuedConnection,
+                                  Q_ARG(int, taken), Q_ARG(int, solutions));
+    }
+}
+
+
+void Sudoky::check_done(int gen, int solutions) {
+    if (state != 4 || gen != board_gen) { // stale
+        return;
     }
 
-    if (selected->text().length() != 1) { // no penmark
-        selected->setText(pencil[sely][selx]); // show pencilmark
-        QFont f2 = selected->font();
-        f2.setPointSize(PENCILPOINT);
-        selected->setFont(f2);
+    if (solutions == 1) {
+        std::lock_guard<std::mutex> guard(check_lock);
+        if (checked_gen != gen) {
+            return;
+        }
+        for (int i = 0; i < 81; ++i) {
+            custom_solution[i / 9][i % 9] = checked_solution[i];
+        }
+    }
+
+    custom_count = solutions;
+    update_label();
+}
+
+
+void Sudoky::update_candidates(int y, int x, int old, int num) {
+    int idx = 9*y + x;
+
+    for (int i = 0; i < CLASSIC.peer_count[idx]; ++i) {
+        int r = CLASSIC.peers[idx][i] / 9;
+        int c = CLASSIC.peers[idx][i] % 9;
+        if (pen[r][c] != 0) {
+            continue;
+        }
+
+        int before = pencil[r][c];
+        if (num != 0) {
+            pencil[r][c] &= ~(1 << num);
+        }
+        if (old != 0 && (work.candidates(r, c) & (1 << old))) {
+            pencil[r][c] |= 1 << old;
+        }
+        if (pencil[r][c] != before) {
+            show_pencil(r, c);
+        }
+    }
+
+    if (num == 0) { // its candidates may have changed while it was filled
+        pencil[y][x] = work.candidates(y, x);
+    }
+}
+
+
+void Sudoky::count_digit(int y, int x, int num, int delta) {
+    int b = 3*(y/3) + x/3;
+    int bit = 1 << num;
+
+    int before = row_count[y][num];
+    row_count[y][num] += delta;
+    if ((before > 1) != (row_count[y][num] > 1)) { // conflict appeared or disappeared
+        row_conflict[y] ^= bit;
+        for (int i = 0; i < 9; ++i) {
+            if (pen[y][i] == num) {
+                paint_cell(y, i);
+            }
+        }
+    }
+
+    before = col_count[x][num];
+    col_count[x][num] += delta;
+    if ((before > 1) != (col_count[x][num] > 1)) {
+        col_conflict[x] ^= bit;
+        for (int i = 0; i < 9; ++i) {
+            if (pen[i][x] == num) {
+                paint_cell(i, x);
+            }
+        }
+    }
+
+    before = box_count[b][num];
+    box_count[b][num] += delta;
+    if ((before > 1) != (box_count[b][num] > 1)) {
+        box_conflict[b] ^= bit;
+        for (int i = 0; i < 9; ++i) {
+            int r = 3*(y/3) + i/3;
+            int c = 3*(x/3) + i%3;
+            if (pen[r][c] == num) {
+                paint_cell(r, c);
+            }
+        }
+    }
+}
+
+
+void Sudoky::paint_cell(int y, int x) {
+    int num = pen[y][x];
+    int conflicts = row_conflict[y] | col_conflict[x] | box_conflict[3*(y/3) + x/3];
+
+    if (num != 0 && (conflicts & (1 << num))) {
+        buttons[y][x]->setStyleSheet(CONFLICTSTYLE);
+    } else if (num != 0 && unlocked[y][x] && 0 <= state && state <= 3 && num != main.board[y][x]) {
+        buttons[y][x]->setStyleSheet(MISTAKESTYLE);
+    } else if (unlocked[y][x]) {
+        buttons[y][x]->setStyleSheet(UNLOCKEDSTYLE);
+    } else {
+        buttons[y][x]->setStyleSheet(LOCKEDSTYLE);
     }
 }
 
@@ -173,7 +432,19 @@ void Sudoky::num_click(int num) {
 void Sudoky::reset_pencil() {
     for (int i = 0; i < 9; ++i) {
         for (int j = 0; j < 9; ++j) {
-            pencil[i][j] = DEFPENCIL;
+            pencil[i][j] = 0;
+        }
+    }
+}
+
+
+void Sudoky::fill_candidates() {
+    for (int i = 0; i < 9; ++i) {
+        for (int j = 0; j < 9; ++j) {
+            if (pen[i][j] == 0) {
+                pencil[i][j] = work.candidates(i, j);
+                show_pencil(i, j);
+            }
         }
     }
 }
@@ -189,13 +460,12 @@ void Sudoky::game_trigger(int diff) {
 
     reset_pencil();
 
-    int blanks = 41 + (rand()%5) + (5*diff); // easy has 41-45 blank spots
-                                             // med 46-50, diff 51-55
+    int blanks = blanks_for(diff);
 
     do {
         main.clear();
-    } while (generate(&main, blanks) != blanks); // generate doesn't always succeed at finding
-                                                 // the given number of blank spots
+    } while (!generate_exact(&main, blanks)); // rarely fails for these blanks, see
+                                              // carve_exact()
 
     set_state(diff);
     update_label();
@@ -205,16 +475,37 @@ void Sudoky::game_trigger(int diff) {
 
 
 void Sudoky::display_sudoku() {
+    for (int i = 0; i < 9; ++i) {
+        row_conflict[i] = 0;
+        col_conflict[i] = 0;
+        box_conflict[i] = 0;
+        for (int k = 0; k < 10; ++k) {
+            row_count[i][k] = 0;
+            col_count[i][k] = 0;
+            box_count[i][k] = 0;
+        }
+    }
+    unsolved = 0;
+
+    work.clear();
+    work.copy(main);
+
     for (int i = 0; i < 9; ++i) {
         for (int j = 0; j < 9; ++j) {
-            if (main.board[j][i] != 0) {
-                buttons[j][i]->setText(QString::number(main.board[j][i]));
+            int val = main.board[j][i];
+            pen[j][i] = val;
+            if (val != 0) {
+                buttons[j][i]->setText(QString::number(val));
                 unlocked[j][i] = false;
-                buttons[j][i]->setStyleSheet("QPushButton {color: grey;}");
+                buttons[j][i]->setStyleSheet(LOCKEDSTYLE);
+                ++row_count[j][val]; // main.board is valid, so no conflicts
+                ++col_count[i][val];
+                ++box_count[3*(j/3) + i/3][val];
             } else {
                 buttons[j][i]->setText(NULL);
                 unlocked[j][i] = true;
-                buttons[j][i]->setStyleSheet("QPushButton {color: black;}");
+                buttons[j][i]->setStyleSheet(UNLOCKEDSTYLE);
+                ++unsolved;
             }
 
             QFont f = buttons[j][i]->font();
@@ -233,17 +524,7 @@ void Sudoky::on_actionCustom_triggered() {
 
 void Sudoky::on_finishButton_clicked() {
     if (0 <= state && state <= 3) {
-        bool equal = true;
-        for (int i = 0; i < 9; ++i) {
-            for (int j = 0; j < 9; ++j) {
-                if (buttons[i][j]->text() != QString::number(main.board[i][j])) {
-                    equal = false;
-                    break;
-                }
-            }
-        }
-
-        if (equal) { // board matches solution
+        if (unsolved == 0) { // board matches solution
             display_sudoku();
             set_state(-1);
             ui->label->setText("Sudoku solved");
@@ -254,16 +535,25 @@ void Sudoky::on_finishButton_clicked() {
 
     } else if (state == 4) {
         main.clear();
-        for (int i = 0; i < 9; ++i) {
-            for (int j = 0; j < 9; ++j) {
-                if (buttons[i][j]->text().length() != 0) {
-                    main.insert(i, j, buttons[i][j]->text().toInt()); // add numbers on the board to main
+        int solutions = custom_count;
+
+        if (solutions == 1) { // already checked, main gets the solution directly
+            for (int i = 0; i < 9; ++i) {
+                for (int j = 0; j < 9; ++j) {
+                    main.insert(i, j, custom_solution[i][j]);
                 }
             }
+        } else if (solutions == -1) { // check still running
+            for (int i = 0; i < 9; ++i) {
+                for (int j = 0; j < 9; ++j) {
+                    if (pen[i][j] != 0) {
+                        main.insert(i, j, pen[i][j]); // add numbers on the board to main
+                    }
+                }
+            }
+            solutions = main.solve();
         }
 
-        int solutions = main.solve();
-
         if (solutions == 0) {
             ui->label->setText("Invalid: No solutions");
             QTimer::singleShot(3000, this, SLOT(update_label()));
@@ -282,7 +572,15 @@ void Sudoky::on_finishButton_clicked() {
 
 void Sudoky::update_label() {
     if (state == 4) {
-        ui->label->setText("Create puzzle");
+        if (custom_count == -1) {
+            ui->label->setText("Create puzzle (checking...)");
+        } else if (custom_count == 0) {
+            ui->label->setText("Create puzzle (no solutions)");
+        } else if (custom_count == 1) {
+            ui->label->setText("Create puzzle (unique solution)");
+        } else {
+            ui->label->setText("Create puzzle (multiple solutions)");
+        }
     } else if (state == 0) {
         ui->label->setText("Easy");
     } else if (state == 1) {
@@ -341,6 +639,10 @@ void Sudoky::set_state(int st) {
         display_sudoku();
 
         reset_pencil();
+
+        ++board_gen; // the empty board has many solutions
+        custom_count = 2;
+        check_stop = true;
     } else { // starting a new game
         if (selected) {
             selected->setChecked(false);
@@ -356,11 +658,14 @@ void Sudoky::set_state(int st) {
         ui->actionSolve->setEnabled(true);
 
         if (st == 3) { // game was custom-made
+            unsolved = 0;
             for (int i = 0; i < 9; ++i) {
                 for (int j = 0; j < 9; ++j) {
-                    if (buttons[i][j]->text().length() == 1) { // spots that are filled
+                    if (pen[i][j] != 0) { // spots that are filled
                         unlocked[i][j] = false;
-                        buttons[i][j]->setStyleSheet("QPushButton {color: grey;}");
+                        buttons[i][j]->setStyleSheet(LOCKEDSTYLE);
+                    } else {
+                        ++unsolved;
                     }
                     QFont f = buttons[j][i]->font();
                     f.setPointSize(PENPOINT);
@@ -374,6 +679,10 @@ void Sudoky::set_state(int st) {
         reset_pencil();
     }
     state = st;
+
+    if (auto_pencil && 0 <= st && st <= 3) {
+        fill_candidates();
+    }
 }
 
 
@@ -470,16 +779,26 @@ void Sudoky::on_actionSolve_triggered() {
 }
 
 
+void Sudoky::on_actionAuto_Candidates_toggled(bool on) {
+    auto_pencil = on;
+
+    if (on && 0 <= state && state <= 3) {
+        fill_candidates();
+    }
+}
+
+
 void Sudoky::on_actionHow_to_Use_triggered() {
    QMessageBox::about(this, "How to play",
                        "<html><b>Start a new game</b> - Select 'Game > New':"
                        "<blockquote>- Easy/Medium/Difficult: Automatically generates a new puzzle.<br>"
-                       "- Custom: Allows user to fill in a custom puzzle. Once filled in, select 'Start Game' to begin solving (puzzle must be valid).</blockquote>"
+                       "- Custom: Allows user to fill in a custom puzzle. Once filled in, select 'Start Game' to begin solving (puzzle must be valid). While filling in, the label shows whether the puzzle has no solution, one, or several.</blockquote>"
                        "<b>Solving a puzzle</b>:"
                        "<blockquote>- To input a number, select the desired position on the board.<br>"
                        "- Use 'Pen' to fill the selected position.<br>"
                        "- Use 'Pencil' to add/remove pencilmarks in the selected position.<br>"
                        "- Pencilmarks will only show if there is no penmark.<br>"
+                       "- Select 'Game > Auto Candidates' to have the pencilmarks filled in and kept up to date as penmarks change.<br>"
                        "- Select 'Finish' when puzzle has been completed.<br>"
                        "- Select 'Game > Solve' to end game and display solution.<br></html>");
 }
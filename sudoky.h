@@ -1,6 +1,10 @@
 #ifndef SUDOKY_H
 #define SUDOKY_H
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <QMainWindow>
 #include <QPushButton>
 #include <QSignalMapper>
@@ -64,8 +68,15 @@ private slots:
 
     // update_label() set the text displayed of label based on the
     //    current state.  Does nothing if state is -1.
+    //    While setting up a custom puzzle, the label also says whether the board
+    //    has no solution, one or several (or that it is still being checked).
     void update_label();
 
+    // check_done(gen, solutions) receives the result of a background check
+    //    (see check_loop()): the board sent as number gen has that many solutions
+    //    (0, 1 or 2 for multiple). Ignored if the board has changed since.
+    void check_done(int gen, int solutions);
+
     // switch_input() switched between penRadio and pencilRadio being checked
     void switch_input();
 
@@ -89,6 +100,11 @@ private slots:
     //    (if a game is being played).  set_state is called to modify the interface.
     void on_actionSolve_triggered();
 
+    // on_actionAuto_Candidates_toggled(on) turns automatic pencilmarks on or off.
+    //    When turned on, the pencilmarks of every empty position are replaced by
+    //    the digits that don't clash with a penmark in its row, column or 3x3 grid
+    void on_actionAuto_Candidates_toggled(bool);
+
     // on_actionHow_to_Use_triggered() displays a QMessgaeBox
     //    explaining how to use the interface.
     void on_actionHow_to_Use_triggered();
@@ -100,9 +116,12 @@ private slots:
 private:
     Ui::Sudoky *ui;
 
-    // holds the pencilmarks for each position. Originally
-    //    filled with DEFPENCIL placeholder (see sudoky.cpp)
-    QString pencil[9][9];
+    // holds the pencilmarks for each position as a mask
+    //    (bit d is set if d is pencilled in), 0 means none
+    int pencil[9][9];
+
+    // true if the pencilmarks follow the candidates in work
+    bool auto_pencil;
 
     // each element points to one button on the board
     QPushButton *buttons[9][9];
@@ -111,6 +130,25 @@ private:
     //    is editable (true) or not (false)
     bool unlocked[9][9];
 
+    // holds the penmark (or given) at each position, 0 means none
+    int pen[9][9];
+
+    // number of times each digit (1-9) appears in each row, column and 3x3 grid
+    int row_count[9][10];
+    int col_count[9][10];
+    int box_count[9][10];
+
+    // bit d of each mask is set when digit d appears more than once in
+    //    the corresponding row, column or 3x3 grid
+    int row_conflict[9];
+    int col_conflict[9];
+    int box_conflict[9];
+
+    // number of editable positions whose penmark differs from the solution
+    //    (blanks included). The puzzle is solved when this reaches 0.
+    //    Only meaningful while a game is being played (0 <= state <= 3)
+    int unsolved;
+
     // correspond to the currently selected position on the board
     //    both are -1 when none selected
     int selx;
@@ -145,6 +183,30 @@ private:
     // holds the current puzzle (see sudoku.hpp)
     Sudoku main;
 
+    // holds the penmarks (and givens) currently on the board, so its
+    //    possibilities are the candidates of each empty position
+    Sudoku work;
+
+    // while setting up a custom puzzle (state 4), the number of changes made to
+    //    the board, and the number of solutions of the board as it is now
+    //    (-1 while a check is running). If it is 1, custom_solution holds the solution
+    int board_gen;
+    int custom_count;
+    int custom_solution[9][9];
+
+    // background checker of custom puzzles (see check_loop()). The members
+    //    below are shared with its thread and guarded by check_lock,
+    //    except check_stop which cancels the solve in progress
+    std::thread checker;
+    std::mutex check_lock;
+    std::condition_variable check_wake;
+    bool check_quit;
+    int check_request; // board_gen of check_cells
+    int check_cells[81];
+    int checked_gen; // board_gen of checked_solution
+    int checked_solution[81];
+    std::atomic<bool> check_stop;
+
     // board_map() initialized the buttons member to contain pointers to each QPushButton on the
     //    sudoku board. Each button to "locked" ('unlocked' member is filled with false), and
     //    connects each button to the board_click slot with an integer representing its location
@@ -162,17 +224,69 @@ private:
     //    arrows (to navigate board), and tab (to switch between input methods).
     void set_shortcuts();
 
-    // reset_pencil() sets every item in the pencil
-    //    member back to the DEFPENCIL placeholder
+    // reset_pencil() clears every pencilmark
     void reset_pencil();
 
+    // fill_candidates() sets the pencilmarks of every empty position to its
+    //    candidates in work, and displays them
+    void fill_candidates();
+
+    // show_pencil(y, x) displays the pencilmarks of the position at row y, column x
+    //    if it has no penmark
+    // requires: 0 <= y, x <= 8
+    void show_pencil(int y, int x);
+
+    // update_candidates(y, x, old, num) updates the automatic pencilmarks of the
+    //    positions sharing a row, column or 3x3 grid with (y, x) after its penmark
+    //    changed from old to num: num is removed from them, and old is added back
+    //    where it has become possible again. Other pencilmarks are left as they are.
+    // requires: 0 <= y, x <= 8
+    //           0 <= old, num <= 9
+    void update_candidates(int y, int x, int old, int num);
+
+    // set_pen(y, x, num) changes the penmark at row y, column x to num (0 to erase),
+    //    updating work, the digit counts, conflict masks and unsolved counter in O(1),
+    //    and repaints the positions whose highlighting changed
+    // requires: 0 <= y, x <= 8
+    //           0 <= num <= 9
+    void set_pen(int y, int x, int num);
+
+    // count_digit(y, x, num, delta) adds delta to the count of num in the row, column
+    //    and 3x3 grid containing (y, x). Whenever a count crosses between 1 and 2, the
+    //    unit's conflict mask is toggled and its positions holding num are repainted
+    // requires: 0 <= y, x <= 8
+    //           1 <= num <= 9
+    //           delta is 1 or -1
+    void count_digit(int y, int x, int num, int delta);
+
+    // paint_cell(y, x) sets the text color of the button at row y, column x:
+    //    red if its penmark conflicts with another one, orange if it differs from
+    //    the solution, otherwise black (editable) or grey (locked)
+    // requires: 0 <= y, x <= 8
+    void paint_cell(int y, int x);
+
     // display_sudoku()  prints out the contents of main.board onto the on-screen board.
     //    Empty positions are set to black text, and 'true' in the unlocked member,
-    //    and the rest are set to grey text and 'false'
+    //    and the rest are set to grey text and 'false'. The penmarks, work, digit
+    //    counts and conflict masks are reset to match main.board
     void display_sudoku();
 
     // set_state(st) modifies the interface based on st, and sets state to st.
     void set_state(int);
+
+    // custom_changed(y, x, old, num) updates custom_count after the penmark at
+    //    row y, column x changed from old to num while setting up a custom puzzle.
+    //    Adding a clue to a board with no solution, or with one (the clue either
+    //    matches it or leaves none), is decided at once; any other change is sent
+    //    to the checker, cancelling the check of the previous board.
+    // requires: 0 <= y, x <= 8
+    //           0 <= old, num <= 9
+    void custom_changed(int y, int x, int old, int num);
+
+    // check_loop() runs on the checker thread until the window is destroyed:
+    //    it waits for a board, counts its solutions (giving up if check_stop is
+    //    set because a newer board arrived) and reports them with check_done()
+    void check_loop();
 };
 
 #endif // SUDOKY_H
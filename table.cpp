@@ -0,0 +1,53 @@
+#include "table.h"
+
+// see table.h for documentation
+
+TranspositionTable::TranspositionTable(size_t entries): mask(1) {
+    while ((mask + 1) * 2 <= entries) {
+        mask = mask * 2 + 1;
+    }
+    words = new std::atomic<uint64_t>[mask + 1];
+    clear();
+}
+
+
+TranspositionTable::~TranspositionTable() {
+    delete[] words;
+}
+
+
+bool TranspositionTable::find(uint64_t key, int *count) const {
+    size_t slot = key & mask & ~(size_t) 1; // both ways share a cache line
+
+    for (size_t i = slot; i <= slot + 1; ++i) {
+        uint64_t word = words[i].load(std::memory_order_relaxed);
+        if (word != 0 && (word & ~COUNT_BITS) == (key & ~COUNT_BITS)) {
+            *count = (int) (word & COUNT_BITS) - 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void TranspositionTable::store(uint64_t key, int count) {
+    size_t slot = key & mask & ~(size_t) 1;
+    uint64_t word = (key & ~COUNT_BITS) | (count + 1);
+
+    // an empty way, or the one already holding key, otherwise the second way:
+    //    the first keeps older entries, the second takes the newest
+    size_t way = slot + 1;
+    uint64_t first = words[slot].load(std::memory_order_relaxed);
+    if (first == 0 || (first & ~COUNT_BITS) == (key & ~COUNT_BITS)) {
+        way = slot;
+    }
+    words[way].store(word, std::memory_order_relaxed);
+}
+
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i <= mask; ++i) {
+        words[i].store(0, std::memory_order_relaxed);
+    }
+}
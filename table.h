@@ -0,0 +1,48 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// TranspositionTable remembers, for boards met during solution counting, how many
+//    solutions their search found: 0 (a dead end) or 1. Boards are keyed by their
+//    64-bit Zobrist hash (see Sudoku::set_table()); like in SolveCache, the key
+//    does not include the Variant, so use a separate table for each variant.
+// Each entry is a single 64-bit word holding the hash and the count, read and
+//    written without locks, so the table may be shared by any number of threads
+//    (e.g. the searches of solve_portfolio()). The table has a fixed number of
+//    entries (2-way set associative); new entries replace old ones.
+class TranspositionTable {
+public:
+    // constructor for TranspositionTable class - holds at most entries counts
+    // requires: entries >= 2
+    explicit TranspositionTable(size_t entries);
+
+    ~TranspositionTable();
+
+    // find(key, count) returns true if the board with hash key is in the table,
+    //    and stores its number of solutions in count
+    bool find(uint64_t key, int *count) const;
+
+    // store(key, count) records that the board with hash key has count solutions
+    // requires: 0 <= count <= 1
+    void store(uint64_t key, int count);
+
+    // clear() empties the table
+    // requires: no find() or store() call is in progress
+    void clear();
+
+private:
+    // the low 2 bits of a word hold count + 1 (0 for an empty entry), the others
+    //    the same bits of the key
+    static const uint64_t COUNT_BITS = 3;
+
+    size_t mask; // number of entries - 1, rounded down to a power of 2
+    std::atomic<uint64_t> *words;
+
+    TranspositionTable(const TranspositionTable &);
+    TranspositionTable &operator=(const TranspositionTable &);
+};
+
+#endif // TABLE_H
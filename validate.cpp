@@ -0,0 +1,377 @@
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include "validate.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VALIDATE_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define VALIDATE_SSSE3 // compiled for SSSE3 separately, used if the CPU has it
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// see validate.h for documentation
+
+namespace {
+
+const uint16_t FULL = 0x1FF; // one bit per digit
+
+// ONEHOT[ch] is the mask of the digit ch, 0 if ch is not '1'-'9'
+struct OneHot {
+    uint16_t mask[256];
+
+    OneHot() {
+        memset(mask, 0, sizeof(mask));
+        for (int d = 1; d <= 9; ++d) {
+            mask['0' + d] = 1 << (d - 1);
+        }
+    }
+};
+const OneHot ONEHOT;
+
+
+// masks_scalar(grid, m) stores the masks of the 81 cells of grid in m
+void masks_scalar(const char *grid, uint16_t *m) {
+    for (int i = 0; i < 81; ++i) {
+        m[i] = ONEHOT.mask[(unsigned char) grid[i]];
+    }
+}
+
+int check_padded(const char *grid);
+
+#ifdef VALIDATE_SSSE3
+
+// masks_ssse3(grid, m) stores the masks of the 81 cells of grid in m, looking
+//    16 digits up at once with pshufb
+// requires: 96 bytes can be read from grid
+__attribute__((target("ssse3")))
+void masks_ssse3(const char *grid, uint16_t *m) {
+    const __m128i low = _mm_setr_epi8(0, 1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i high = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i ten = _mm_set1_epi8(10);
+
+    for (int i = 0; i < 96; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (grid + i));
+        // digit value, or 10 (an empty mask) for anything but '0'-'9'
+        __m128i idx = _mm_min_epu8(_mm_sub_epi8(c, zero), ten);
+        __m128i lo = _mm_shuffle_epi8(low, idx);
+        __m128i hi = _mm_shuffle_epi8(high, idx);
+        _mm_storeu_si128((__m128i *) (m + i), _mm_unpacklo_epi8(lo, hi));
+        _mm_storeu_si128((__m128i *) (m + i + 8), _mm_unpackhi_epi8(lo, hi));
+    }
+}
+
+// check_batch(data, stride, failed) checks the 16 grids stored stride bytes apart
+//    in data at once: the grids are transposed so that each vector holds one cell
+//    of all 16, and the unit masks are ORed lane by lane. Stores -1 in failed[i]
+//    for valid grids, and returns the number of them. Invalid grids are checked
+//    again one at a time to find their first invalid unit.
+// requires: 96 bytes can be read from each grid
+__attribute__((target("ssse3")))
+int check_batch(const char *data, size_t stride, int *failed) {
+    const __m128i low = _mm_setr_epi8(0, 1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i high = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i ten = _mm_set1_epi8(10);
+    const __m128i full_lo = _mm_set1_epi8((char) 0xFF); // digits 1-8
+    const __m128i full_hi = _mm_set1_epi8(1);           // digit 9
+
+    __m128i ok = full_lo; // lane i stays 0xFF while grid i is valid
+    __m128i row_lo = _mm_setzero_si128();
+    __m128i row_hi = _mm_setzero_si128();
+    __m128i col_lo[9];
+    __m128i col_hi[9];
+    __m128i box_lo[3];
+    __m128i box_hi[3];
+    for (int i = 0; i < 9; ++i) {
+        col_lo[i] = col_hi[i] = _mm_setzero_si128();
+    }
+    for (int i = 0; i < 3; ++i) {
+        box_lo[i] = box_hi[i] = _mm_setzero_si128();
+    }
+
+    // fully unrolled, so every index below is a constant and all vectors stay in registers
+#pragma GCC unroll 6
+    for (int k = 0; k < 6; ++k) { // cells 16k to 16k + 15
+        __m128i v[16];
+        __m128i t[16];
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; ++g) {
+            v[g] = _mm_loadu_si128((const __m128i *) (data + g*stride + 16*k));
+        }
+#pragma GCC unroll 4
+        for (int round = 0; round < 4; ++round) { // 16x16 byte transpose
+#pragma GCC unroll 8
+            for (int i = 0; i < 8; ++i) {
+                t[2*i] = _mm_unpacklo_epi8(v[i], v[i + 8]);
+                t[2*i + 1] = _mm_unpackhi_epi8(v[i], v[i + 8]);
+            }
+#pragma GCC unroll 16
+            for (int i = 0; i < 16; ++i) {
+                v[i] = t[i];
+            }
+        }
+
+#pragma GCC unroll 16
+        for (int j = 0; j < 16; ++j) {
+            int cell = 16*k + j;
+            int c = cell % 9;
+            if (cell >= 81) {
+                continue;
+            }
+
+            __m128i idx = _mm_min_epu8(_mm_sub_epi8(v[j], zero), ten);
+            __m128i lo = _mm_shuffle_epi8(low, idx);
+            __m128i hi = _mm_shuffle_epi8(high, idx);
+
+            row_lo = _mm_or_si128(row_lo, lo);
+            row_hi = _mm_or_si128(row_hi, hi);
+            col_lo[c] = _mm_or_si128(col_lo[c], lo);
+            col_hi[c] = _mm_or_si128(col_hi[c], hi);
+            box_lo[c / 3] = _mm_or_si128(box_lo[c / 3], lo);
+            box_hi[c / 3] = _mm_or_si128(box_hi[c / 3], hi);
+
+            if (c == 8) { // end of a row
+                ok = _mm_and_si128(ok, _mm_and_si128(_mm_cmpeq_epi8(row_lo, full_lo),
+                                                     _mm_cmpeq_epi8(row_hi, full_hi)));
+                row_lo = row_hi = _mm_setzero_si128();
+            }
+            if (cell % 27 == 26) { // end of a band
+                for (int b = 0; b < 3; ++b) {
+                    ok = _mm_and_si128(ok, _mm_and_si128(_mm_cmpeq_epi8(box_lo[b], full_lo),
+                                                         _mm_cmpeq_epi8(box_hi[b], full_hi)));
+                    box_lo[b] = box_hi[b] = _mm_setzero_si128();
+                }
+            }
+        }
+    }
+
+    for (int c = 0; c < 9; ++c) {
+        ok = _mm_and_si128(ok, _mm_and_si128(_mm_cmpeq_epi8(col_lo[c], full_lo),
+                                             _mm_cmpeq_epi8(col_hi[c], full_hi)));
+    }
+
+    int valid = _mm_movemask_epi8(ok);
+    for (int g = 0; g < 16; ++g) {
+        failed[g] = (valid & (1 << g)) ? -1 : check_padded(data + g*stride);
+    }
+
+    return __builtin_popcount(valid);
+}
+
+// has_ssse3() returns true if the CPU running the program has SSSE3
+bool has_ssse3() {
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3"));
+    return has;
+}
+
+#endif
+
+
+// check_masks(m) returns -1 if every unit of the cell masks m is full, otherwise
+//    the number of the first unit that isn't
+// requires: m has 96 elements (the ones past 81 are ignored)
+int check_masks(const uint16_t *m) {
+    for (int r = 0; r < 9; ++r) {
+        const uint16_t *row = m + 9*r;
+        if ((row[0] | row[1] | row[2] | row[3] | row[4] |
+             row[5] | row[6] | row[7] | row[8]) != FULL) {
+            return r;
+        }
+    }
+
+    uint16_t cols[9];
+    uint16_t bands[3][9]; // OR of the 3 rows of each band, per column
+
+#ifdef VALIDATE_SSE2
+    // columns 0-7 in one vector per band, column 8 on its own
+    __m128i all = _mm_setzero_si128();
+    for (int b = 0; b < 3; ++b) {
+        const uint16_t *top = m + 27*b;
+        __m128i v = _mm_or_si128(_mm_or_si128(
+                        _mm_loadu_si128((const __m128i *) top),
+                        _mm_loadu_si128((const __m128i *) (top + 9))),
+                        _mm_loadu_si128((const __m128i *) (top + 18)));
+        _mm_storeu_si128((__m128i *) bands[b], v);
+        bands[b][8] = top[8] | top[17] | top[26];
+        all = _mm_or_si128(all, v);
+    }
+    _mm_storeu_si128((__m128i *) cols, all);
+    cols[8] = bands[0][8] | bands[1][8] | bands[2][8];
+#else
+    for (int b = 0; b < 3; ++b) {
+        const uint16_t *top = m + 27*b;
+        for (int c = 0; c < 9; ++c) {
+            bands[b][c] = top[c] | top[9 + c] | top[18 + c];
+        }
+    }
+    for (int c = 0; c < 9; ++c) {
+        cols[c] = bands[0][c] | bands[1][c] | bands[2][c];
+    }
+#endif
+
+    for (int c = 0; c < 9; ++c) {
+        if (cols[c] != FULL) {
+            return 9 + c;
+        }
+    }
+
+    for (int g = 0; g < 9; ++g) {
+        const uint16_t *band = bands[g / 3] + 3*(g % 3);
+        if ((band[0] | band[1] | band[2]) != FULL) {
+            return 18 + g;
+        }
+    }
+
+    return -1;
+}
+
+
+// check_padded(grid) is check_grid(grid) when 96 bytes can be read from grid
+int check_padded(const char *grid) {
+    uint16_t m[96];
+#ifdef VALIDATE_SSSE3
+    if (has_ssse3()) {
+        masks_ssse3(grid, m);
+        return check_masks(m);
+    }
+#endif
+    masks_scalar(grid, m);
+    return check_masks(m);
+}
+
+
+// unit_name(unit, buf) writes the name of unit into buf, e.g. "column 3"
+//    (rows, columns and grids are numbered from 1 for display)
+// requires: buf has room for 16 characters
+void unit_name(int unit, char *buf) {
+    const char *kinds[3] = {"row", "column", "grid"};
+    snprintf(buf, 16, "%s %d", kinds[unit / 9], unit % 9 + 1);
+}
+
+} // namespace
+
+
+int check_grid(const char *grid) {
+    char padded[96] = {0};
+    memcpy(padded, grid, 81);
+    return check_padded(padded);
+}
+
+
+int check_grids(const char *data, size_t count, size_t stride, int *failed) {
+    int valid = 0;
+    size_t end = count > 0 ? (count - 1) * stride + 81 : 0; // bytes that can be read
+
+    size_t i = 0;
+#ifdef VALIDATE_SSSE3
+    if (has_ssse3()) {
+        for (; i + 16 <= count && (i + 15) * stride + 96 <= end; i += 16) {
+            valid += check_batch(data + i * stride, stride, failed + i);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const char *grid = data + i * stride;
+        // grids followed by at least 15 more bytes are read in place
+        failed[i] = i * stride + 96 <= end ? check_padded(grid) : check_grid(grid);
+        valid += failed[i] == -1;
+    }
+
+    return valid;
+}
+
+
+int validate_file(const char *path, FILE *out) {
+    size_t size = 0;
+    const char *data = NULL;
+    std::vector<char> contents; // used if the file can't be mapped
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return 2;
+    }
+    size = st.st_size;
+    void *map = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map != MAP_FAILED) {
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = (const char *) map;
+    }
+#endif
+
+    if (!data && size > 0) {
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            perror(path);
+            return 2;
+        }
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            contents.insert(contents.end(), buf, buf + n);
+        }
+        fclose(f);
+        size = contents.size();
+        data = contents.data();
+    }
+
+    // every line has the same length as the first one
+    size_t stride = 81;
+    if (size > 81 && data[81] == '\n') {
+        stride = 82;
+    } else if (size > 82 && data[81] == '\r' && data[82] == '\n') {
+        stride = 83;
+    }
+    size_t count = (size + stride - 81) / stride; // the last newline is optional
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    const size_t CHUNK = 4096; // grids checked before writing out the invalid ones
+    int failed[CHUNK];
+    size_t valid = 0;
+    for (size_t first = 0; first < count; first += CHUNK) {
+        size_t n = count - first < CHUNK ? count - first : CHUNK;
+        size_t ok = check_grids(data + first * stride, n, stride, failed);
+        valid += ok;
+        if (ok == n) {
+            continue;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (failed[i] != -1) {
+                char name[16];
+                unit_name(failed[i], name);
+                fprintf(out, "%zu %s\n", first + i + 1, name);
+            }
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    fprintf(stderr, "%zu grids, %zu valid, %zu invalid, %.2f GB/s\n", count, valid,
+            count - valid, elapsed > 0 ? count * stride / elapsed / 1e9 : 0.0);
+
+#ifndef _WIN32
+    if (contents.empty() && size > 0) {
+        munmap((void *) data, size);
+    }
+#endif
+
+    return valid == count ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <cstddef>
+#include <cstdio>
+
+// Bulk checking of solved classic grids, for when only a yes/no answer is
+//    needed (unlike Sudoku::valid(), blanks are not allowed). Each cell is turned
+//    into a one-hot digit mask, 16 cells at a time with SIMD on x86, and a unit is
+//    correct when the OR of its 9 masks has all 9 bits set. Any character other
+//    than '1'-'9' gives an empty mask, so it makes its units fail.
+//
+// Units are numbered like in Variant (see sudoku.h): rows 0-8, columns 9-17,
+//    3x3 grids 18-26.
+
+// check_grid(grid) returns -1 if the 81 characters of grid (row-major) form a
+//    valid full grid, otherwise the number of the first unit that is not valid
+int check_grid(const char *grid);
+
+// check_grids(data, count, stride, failed) checks the count grids stored stride
+//    bytes apart in data, and stores the result of check_grid() for grid i in
+//    failed[i]. Returns the number of valid grids.
+// requires: stride >= 81
+int check_grids(const char *data, size_t count, size_t stride, int *failed);
+
+// validate_file(path, out) maps the file at path, which holds one grid per line
+//    (81 characters, then "\n" or "\r\n"), checks every grid and writes
+//    "<line> <unit>" to out for each invalid one, e.g. "12 column 3". The
+//    totals and throughput go to stderr. Returns 0 if every grid is valid,
+//    1 if some are not, and 2 if the file could not be read.
+int validate_file(const char *path, FILE *out);
+
+#endif // VALIDATE_H